@@ -0,0 +1,163 @@
+#include <array>
+#include <cstdint>
+#include <fmt/format.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HEX_DECODER_X86 1
+#endif
+
+#include <common/hex_decoder.h>
+#include <common/exception.h>
+
+namespace {
+    constexpr uint8_t invalid_digit = 0xFF;
+
+    constexpr std::array<uint8_t, 256> make_digit_table() {
+        std::array<uint8_t, 256> table{};
+        for (auto & digit : table) {
+            digit = invalid_digit;
+        }
+        for (int c = '0'; c <= '9'; ++c) {
+            table[c] = static_cast<uint8_t>(c - '0');
+        }
+        for (int c = 'a'; c <= 'f'; ++c) {
+            table[c] = static_cast<uint8_t>(c - 'a' + 10);
+            table[c - 'a' + 'A'] = static_cast<uint8_t>(c - 'a' + 10);
+        }
+        return table;
+    }
+
+    constexpr std::array<uint8_t, 256> digit_table = make_digit_table();
+
+    [[noreturn]] void throw_invalid(const char *data, size_t size) {
+        for (size_t i = 0; i < size; ++i) {
+            if (digit_table[static_cast<uint8_t>(data[i])] == invalid_digit) {
+                throw exception(error_codes::INVALID_INPUT,
+                                fmt::format("Invalid hex digit {:#04x} at position {}", static_cast<uint8_t>(data[i]), i));
+            }
+        }
+        throw exception(error_codes::INVALID_INPUT, "Invalid hex digit");
+    }
+
+    void decode_scalar(const char *data, size_t size, char *out) {
+        for (size_t i = 0; i < size; i += 2) {
+            uint8_t high = digit_table[static_cast<uint8_t>(data[i])];
+            uint8_t low = digit_table[static_cast<uint8_t>(data[i + 1])];
+            if ((high | low) & 0xF0) {
+                throw_invalid(data + i, 2);
+            }
+            out[i / 2] = static_cast<char>((high << 4) | low);
+        }
+    }
+
+#ifdef HEX_DECODER_X86
+    /// Digit values of 16 characters; valid gets 0xFF for every hex digit.
+    __attribute__((target("sse2")))
+    inline __m128i digits_sse2(__m128i chars, __m128i &valid) {
+        const __m128i lower = _mm_or_si128(chars, _mm_set1_epi8(0x20));
+        const __m128i is_digit = _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8('0' - 1)),
+                                               _mm_cmplt_epi8(chars, _mm_set1_epi8('9' + 1)));
+        const __m128i is_alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                               _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+        valid = _mm_or_si128(is_digit, is_alpha);
+        return _mm_or_si128(_mm_and_si128(is_digit, _mm_sub_epi8(chars, _mm_set1_epi8('0'))),
+                            _mm_and_si128(is_alpha, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10))));
+    }
+
+    __attribute__((target("sse2")))
+    void decode_sse2(const char *data, size_t size, char *out) {
+        size_t i = 0;
+        for (; i + 16 <= size; i += 16) {
+            __m128i valid;
+            const __m128i digits = digits_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i)), valid);
+            if (_mm_movemask_epi8(valid) != 0xFFFF) {
+                throw_invalid(data + i, 16);
+            }
+            // Little endian 16-bit lanes hold (low << 8) | high
+            const __m128i high = _mm_slli_epi16(_mm_and_si128(digits, _mm_set1_epi16(0x00FF)), 4);
+            const __m128i low = _mm_srli_epi16(digits, 8);
+            const __m128i bytes = _mm_packus_epi16(_mm_or_si128(high, low), _mm_setzero_si128());
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(out + i / 2), bytes);
+        }
+        decode_scalar(data + i, size - i, out + i / 2);
+    }
+
+    __attribute__((target("avx2")))
+    void decode_avx2(const char *data, size_t size, char *out) {
+        size_t i = 0;
+        for (; i + 32 <= size; i += 32) {
+            const __m256i chars = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+            const __m256i lower = _mm256_or_si256(chars, _mm256_set1_epi8(0x20));
+            const __m256i is_digit = _mm256_and_si256(_mm256_cmpgt_epi8(chars, _mm256_set1_epi8('0' - 1)),
+                                                      _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), chars));
+            const __m256i is_alpha = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+                                                      _mm256_cmpgt_epi8(_mm256_set1_epi8('f' + 1), lower));
+            if (static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(is_digit, is_alpha))) != 0xFFFFFFFFu) {
+                throw_invalid(data + i, 32);
+            }
+            const __m256i digits = _mm256_or_si256(
+                _mm256_and_si256(is_digit, _mm256_sub_epi8(chars, _mm256_set1_epi8('0'))),
+                _mm256_and_si256(is_alpha, _mm256_sub_epi8(lower, _mm256_set1_epi8('a' - 10))));
+            // high * 16 + low for every pair of digits
+            const __m256i pairs = _mm256_maddubs_epi16(digits, _mm256_set1_epi16(0x0110));
+            // packus works per 128-bit lane, gather the two low halves
+            const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(pairs, pairs), 0b1000);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i / 2), _mm256_castsi256_si128(packed));
+        }
+        decode_sse2(data + i, size - i, out + i / 2);
+    }
+#endif
+
+    using decode_function = void (*)(const char *, size_t, char *);
+
+    struct decoder {
+        decode_function function;
+        const char *name;
+    };
+
+    decoder select_decoder() {
+#ifdef HEX_DECODER_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return {decode_avx2, "avx2"};
+        }
+        if (__builtin_cpu_supports("sse2")) {
+            return {decode_sse2, "sse2"};
+        }
+#endif
+        return {decode_scalar, "scalar"};
+    }
+
+    const decoder & get_decoder() {
+        static const decoder selected = select_decoder();
+        return selected;
+    }
+} // namespace
+
+namespace hex {
+    void decode(const char *data, size_t size, char *out) {
+        if (size % 2 != 0) {
+            throw exception(error_codes::INVALID_INPUT, "Odd length of hex encoded message");
+        }
+        get_decoder().function(data, size, out);
+    }
+
+    void decode_bytea(const char *data, size_t size, std::string &out) {
+        // Skip '\x'
+        if (size >= 2 && data[0] == '\\' && data[1] == 'x') {
+            data += 2;
+            size -= 2;
+        }
+        if (size % 2 != 0) {
+            throw exception(error_codes::INVALID_INPUT, "Odd length of hex encoded message");
+        }
+
+        out.resize(size / 2);
+        get_decoder().function(data, size, out.data());
+    }
+
+    const char *implementation() {
+        return get_decoder().name;
+    }
+}
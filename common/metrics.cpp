@@ -0,0 +1,43 @@
+#include <fstream>
+#include <unistd.h>
+#include <fmt/format.h>
+
+#include <common/metrics.h>
+
+metrics & metrics::instance() {
+    static metrics registry;
+    return registry;
+}
+
+void metrics::set_gauge(const std::string & name, int64_t value) {
+    std::lock_guard guard(metrics_mutex);
+    values[name] = value;
+}
+
+void metrics::add_counter(const std::string & name, int64_t delta) {
+    std::lock_guard guard(metrics_mutex);
+    values[name] += delta;
+}
+
+std::map<std::string, int64_t> metrics::snapshot() const {
+    std::lock_guard guard(metrics_mutex);
+    return values;
+}
+
+std::string metrics::to_string() const {
+    std::string result;
+    for (const auto & [name, value] : snapshot()) {
+        result += fmt::format("{} {}\n", name, value);
+    }
+    return result;
+}
+
+size_t metrics::resident_memory_bytes() {
+    std::ifstream statm("/proc/self/statm");
+    size_t total_pages = 0;
+    size_t resident_pages = 0;
+    if (!(statm >> total_pages >> resident_pages)) {
+        return 0;
+    }
+    return resident_pages * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <utility>
+#include <vector>
+
+/// Bump allocator for objects that live for one batch: deallocate() is a no-op and release()
+/// frees everything at once. Blocks are kept for the next batch up to retained_bytes, so a
+/// steady stream of batches does not touch the upstream allocator. Not thread safe.
+class batch_arena : public std::pmr::memory_resource {
+public:
+    explicit batch_arena(size_t block_size_ = 1 << 20,
+                         size_t retained_bytes_ = 64 << 20,
+                         std::pmr::memory_resource *upstream_ = std::pmr::new_delete_resource())
+        : block_size(block_size_ ? block_size_ : 1),
+          retained_bytes(retained_bytes_),
+          upstream(upstream_) {
+    }
+
+    batch_arena(const batch_arena &) = delete;
+    batch_arena &operator=(const batch_arena &) = delete;
+
+    ~batch_arena() override {
+        release();
+        for (std::byte *data : blocks) {
+            upstream->deallocate(data, block_size, alignof(std::max_align_t));
+        }
+    }
+
+    /// Rewinds to the first block; objects allocated here must already be destroyed.
+    void release() {
+        for (const auto &[data, size] : large_blocks) {
+            upstream->deallocate(data, size, alignof(std::max_align_t));
+        }
+        large_blocks.clear();
+
+        size_t retained_blocks = std::max<size_t>(retained_bytes / block_size, 1);
+        while (blocks.size() > retained_blocks) {
+            upstream->deallocate(blocks.back(), block_size, alignof(std::max_align_t));
+            blocks.pop_back();
+        }
+
+        current = 0;
+        offset = 0;
+        used = 0;
+    }
+
+    /// Bytes handed out since the last release.
+    size_t bytes_used() const { return used; }
+
+    /// Bytes held from upstream.
+    size_t bytes_reserved() const {
+        size_t reserved = blocks.size() * block_size;
+        for (const auto &[data, size] : large_blocks) {
+            reserved += size;
+        }
+        return reserved;
+    }
+
+private:
+    void *do_allocate(size_t bytes, size_t alignment) override {
+        used += bytes;
+
+        // Oversized objects get a block of their own, freed on release
+        if (bytes + alignment > block_size || alignment > alignof(std::max_align_t)) {
+            size_t size = bytes + alignment;
+            auto *data = static_cast<std::byte *>(upstream->allocate(size, alignof(std::max_align_t)));
+            large_blocks.emplace_back(data, size);
+            auto address = reinterpret_cast<std::uintptr_t>(data);
+            return data + (((address + alignment - 1) & ~(alignment - 1)) - address);
+        }
+
+        while (current < blocks.size()) {
+            size_t start = (offset + alignment - 1) & ~(alignment - 1);
+            if (start + bytes <= block_size) {
+                offset = start + bytes;
+                return blocks[current] + start;
+            }
+            ++current;
+            offset = 0;
+        }
+
+        blocks.push_back(static_cast<std::byte *>(upstream->allocate(block_size, alignof(std::max_align_t))));
+        current = blocks.size() - 1;
+        offset = bytes;
+        return blocks.back();
+    }
+
+    void do_deallocate(void *, size_t, size_t) override {
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+        return this == &other;
+    }
+
+    const size_t block_size;
+    const size_t retained_bytes;
+    std::pmr::memory_resource *upstream;
+
+    /// Blocks of block_size, [0, current) are full and current is being filled.
+    std::vector<std::byte *> blocks;
+    std::vector<std::pair<std::byte *, size_t>> large_blocks;
+    size_t current = 0;
+    size_t offset = 0;
+    size_t used = 0;
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+/// Blocking FIFO with a capacity limit, producers wait while the queue is full.
+/// After close() pushes fail and pops drain the remaining items, then return std::nullopt.
+template<typename T>
+class bounded_queue {
+public:
+    explicit bounded_queue(size_t capacity_)
+        : capacity(capacity_ ? capacity_ : 1) {
+    }
+
+    bool push(T && item) {
+        std::unique_lock lock(queue_mutex);
+        not_full.wait(lock, [this] { return closed || items.size() < capacity; });
+        if (closed) {
+            return false;
+        }
+        items.push_back(std::move(item));
+        not_empty.notify_one();
+        return true;
+    }
+
+    /// Moves from item only on success.
+    template<typename Rep, typename Period>
+    bool push_for(T & item, std::chrono::duration<Rep, Period> timeout) {
+        std::unique_lock lock(queue_mutex);
+        if (!not_full.wait_for(lock, timeout, [this] { return closed || items.size() < capacity; }) || closed) {
+            return false;
+        }
+        items.push_back(std::move(item));
+        not_empty.notify_one();
+        return true;
+    }
+
+    std::optional<T> pop() {
+        std::unique_lock lock(queue_mutex);
+        not_empty.wait(lock, [this] { return closed || !items.empty(); });
+        return take();
+    }
+
+    template<typename Rep, typename Period>
+    std::optional<T> pop_for(std::chrono::duration<Rep, Period> timeout) {
+        std::unique_lock lock(queue_mutex);
+        not_empty.wait_for(lock, timeout, [this] { return closed || !items.empty(); });
+        return take();
+    }
+
+    void close() {
+        std::lock_guard guard(queue_mutex);
+        closed = true;
+        not_empty.notify_all();
+        not_full.notify_all();
+    }
+
+    bool is_closed() const {
+        std::lock_guard guard(queue_mutex);
+        return closed && items.empty();
+    }
+
+    size_t size() const {
+        std::lock_guard guard(queue_mutex);
+        return items.size();
+    }
+
+private:
+    std::optional<T> take() {
+        if (items.empty()) {
+            return std::nullopt;
+        }
+        std::optional<T> item(std::move(items.front()));
+        items.pop_front();
+        not_full.notify_one();
+        return item;
+    }
+
+    const size_t capacity;
+    bool closed = false;
+    std::deque<T> items;
+    mutable std::mutex queue_mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+};
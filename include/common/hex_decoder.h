@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace hex {
+    /// Decodes size hex digits (size must be even) into size / 2 bytes at out.
+    /// The implementation is picked once at runtime: AVX2, SSE2 or scalar.
+    /// Throws INVALID_INPUT on a character that is not a hex digit.
+    void decode(const char *data, size_t size, char *out);
+
+    /// Decodes bytea output ('\x' followed by hex digits) into out, reusing its capacity.
+    void decode_bytea(const char *data, size_t size, std::string &out);
+
+    /// Name of the implementation in use, for logging.
+    const char *implementation();
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+
+/// Bytes reserved by concurrent loads, acquire() waits while the budget is exhausted.
+/// A limit of 0 means no limit; a request above the limit is granted once nothing else is reserved.
+class memory_budget {
+public:
+    explicit memory_budget(size_t limit_)
+        : limit(limit_) {
+    }
+
+    void acquire(size_t bytes) {
+        if (limit == 0) {
+            return;
+        }
+        std::unique_lock lock(budget_mutex);
+        released.wait(lock, [this, bytes] { return reserved == 0 || reserved + bytes <= limit; });
+        reserved += bytes;
+    }
+
+    void release(size_t bytes) {
+        if (limit == 0) {
+            return;
+        }
+        {
+            std::lock_guard guard(budget_mutex);
+            reserved -= bytes;
+        }
+        released.notify_all();
+    }
+
+private:
+    const size_t limit;
+    size_t reserved = 0;
+    std::mutex budget_mutex;
+    std::condition_variable released;
+};
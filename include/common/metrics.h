@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+/// Process-wide registry of counters and gauges.
+class metrics {
+public:
+    static metrics & instance();
+
+    void set_gauge(const std::string & name, int64_t value);
+
+    void add_counter(const std::string & name, int64_t delta = 1);
+
+    std::map<std::string, int64_t> snapshot() const;
+
+    /// One "name value" line per metric.
+    std::string to_string() const;
+
+    /// Resident set size of the process, 0 when /proc is not available.
+    static size_t resident_memory_bytes();
+
+private:
+    metrics() = default;
+
+    mutable std::mutex metrics_mutex;
+    std::map<std::string, int64_t> values;
+};
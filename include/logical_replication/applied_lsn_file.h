@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+
+#include <common/logger.h>
+
+/// Last lsn whose changes are written to otterbrix, one state file per slot.
+/// Saved before the lsn is confirmed to the server, so the file is never behind the slot.
+class applied_lsn_file {
+public:
+    applied_lsn_file(const std::filesystem::path & directory_, const std::string & slot_name_, logger *logger_);
+
+    /// Empty when there is no file or it can not be parsed.
+    std::optional<uint64_t> load() const;
+
+    /// Replaces the file through a rename; a repeated lsn is not written again.
+    void save(uint64_t lsn);
+
+    void remove();
+
+private:
+    const std::filesystem::path path;
+    logger *current_logger;
+    std::optional<uint64_t> saved_lsn;
+};
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include <logical_replication/replication_settings.h>
+
+/// Picks the number of changes fetched per consume() call.
+/// Grows while the consumer is behind and batches stay under the target latency,
+/// shrinks on slow batches, memory pressure or light traffic.
+class batch_size_controller {
+public:
+    /// Throws when the minimum batch size is above the maximum.
+    batch_size_controller(size_t initial_block_size, const adaptive_batch_settings & settings_);
+
+    size_t update(size_t fetched, std::chrono::microseconds apply_latency, uint64_t lag_bytes, size_t memory_bytes);
+
+    size_t get() const { return current; }
+
+private:
+    adaptive_batch_settings settings;
+    size_t current;
+};
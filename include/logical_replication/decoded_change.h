@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <postgres/postgres_types.h>
+#include <otterbrix/row_decoder.h>
+
+/// Table schema as of the last Relation message, immutable once published.
+struct relation_info {
+    int32_t table_id = 0;
+    std::string table_name;
+    std::vector<std::pair<std::string, int32_t>> columns;
+    std::vector<int32_t> primary_key;
+
+    /// Decoder plan of columns; a Relation message publishes a new relation_info and so a new plan.
+    tsl::row_decoder decoder;
+};
+
+using relation_ptr = std::shared_ptr<const relation_info>;
+
+/// One parsed pgoutput message ready to be applied.
+/// Carries its own relation snapshot, so the apply side never touches the decoder's maps.
+struct decoded_change {
+    postgre_sql_type_operation type_operation = postgre_sql_type_operation::NOT_PROCESSED;
+    relation_ptr relation;
+    replication_row result;
+
+    /// Old key ('K') or old row ('O') of an Update, empty when the message has none.
+    replication_row old_value;
+
+    /// End lsn of the transaction when the message commits it, 0 otherwise.
+    uint64_t commit_lsn = 0;
+
+    /// Commit lsn of the transaction the message belongs to, lower than its end lsn.
+    uint64_t transaction_lsn = 0;
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <common/logger.h>
+#include <logical_replication/decoded_change.h>
+
+/// Row changes of tables whose initial load is still running, one file per table.
+/// They are replayed in arrival (lsn) order once the table is loaded.
+class held_change_spool {
+public:
+    using change_handler = std::function<void(const decoded_change & change)>;
+
+    held_change_spool(const std::filesystem::path & directory_, const std::string & prefix_, logger *logger_);
+
+    ~held_change_spool();
+
+    void append(const decoded_change & change);
+
+    /// The changes appended so far belong to committed transactions.
+    void commit();
+
+    /// Drops the changes appended since the last commit(), the server sends their transaction again.
+    void discard_uncommitted();
+
+    /// Feeds every held change of the table to handler and removes its file.
+    void replay(const std::string & table_name, const change_handler & handler);
+
+    uint64_t bytes() const { return total_bytes; }
+
+    bool empty() const { return files.empty(); }
+
+private:
+    struct table_file {
+        std::filesystem::path path;
+        std::ofstream stream;
+        uint64_t bytes = 0;
+        uint64_t changes = 0;
+        uint64_t committed_bytes = 0;
+        uint64_t committed_changes = 0;
+
+        /// Relation snapshots referenced by the records, a new one after every Relation message.
+        std::vector<relation_ptr> relations;
+    };
+
+    void write_row(table_file & file, const replication_row & row);
+
+    void read_row(std::ifstream & input, replication_row & row);
+
+    std::filesystem::path directory;
+    std::string prefix;
+    std::unordered_map<std::string, table_file> files;
+    uint64_t total_bytes = 0;
+    size_t next_file = 0;
+
+    std::string value_buffer;
+    decoded_change replayed;
+    logger *current_logger;
+};
@@ -1,12 +1,28 @@
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
 #include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
 #include <unordered_set>
 
 #include <postgres/сonnection.h>
+#include <postgres/replication_stream.h>
 #include <common/logger.h>
 #include <otterbrix/otterbrix_service.h>
 #include <postgres/postgres_settings.h>
+#include <logical_replication/replication_settings.h>
+#include <logical_replication/transaction_spool.h>
+#include <logical_replication/batch_size_controller.h>
+#include <logical_replication/decoded_change.h>
+#include <logical_replication/parallel_applier.h>
+#include <logical_replication/applied_lsn_file.h>
+#include <logical_replication/held_change_spool.h>
+#include <common/bounded_queue.h>
+
+class logical_replication_parser;
 
 class logical_replication_consumer {
 public:
@@ -18,11 +34,110 @@ public:
     const std::string & publication_name_,
     const std::string & start_lsn,
     size_t max_block_size_,
-    logger *logger_);
+    logger *logger_,
+    const replication_settings & settings_ = {});
+
+    ~logical_replication_consumer();
 
     bool consume();
 
+    size_t get_batch_size() const { return max_block_size; }
+
+    /// Concurrent initial load: row changes of these tables are held until their load is finished.
+    /// loads_applied is called on the consuming thread once every held change is applied, before confirmation
+    /// moves past the snapshot. Must be called before the first consume().
+    void hold_tables(const std::vector<std::string> & table_names, std::function<void()> loads_applied);
+
+    /// Resumed initial load: changes of transactions committed before lsn may be in the tables already,
+    /// their inserts and updates are written over the row with the same primary key. Must be called before the first consume().
+    void reconcile_until(uint64_t lsn);
+
+    /// Called from the loading thread once every part of the table is written.
+    void finish_table_load(const std::string & table_name);
+
+    /// The load failed: the next consume() throws and the confirmed lsn stays at the snapshot,
+    /// so a restart loads the tables again.
+    void abandon_table_loads();
+
 private:
+    /// pgoutput options as (name, value) pairs, shared by both modes.
+    std::vector<std::pair<std::string, std::string>> plugin_options() const;
+
+    bool consume_polling();
+
+    bool consume_streaming();
+
+    /// Apply stage of the pipeline, runs on the caller thread.
+    bool consume_pipelined();
+
+    using change_sink = std::function<void(decoded_change &&)>;
+
+    /// Spools changes of streamed transactions, everything else is decoded and passed to sink in commit order.
+    void process_message(const char *message, size_t size, const change_sink & sink);
+
+    /// Returns false when the message carries neither a row change nor a commit.
+    bool decode_message(const char *message, size_t size, decoded_change & change);
+
+    /// Applies the change here or hands it to the parallel applier, holds it when its table is loading.
+    /// Changes of transactions already dispatched are dropped.
+    void dispatch_change(decoded_change && change);
+
+    void hold_change(const decoded_change & change);
+
+    /// False while the held changes are over held_changes_limit_bytes: waits up to wait_timeout for a load
+    /// to finish and applies it, so the caller can keep talking to the server between the waits.
+    bool can_read_changes();
+
+    /// Applies the held changes of the tables loaded since the last call, on the consuming thread.
+    /// Throws when the load failed.
+    void replay_loaded_tables();
+
+    /// Moves result_lsn to an applied commit, unless confirmation is frozen by held changes.
+    void advance_result_lsn(uint64_t lsn);
+
+    /// Collects the row changes of the open transaction and writes them at its commit.
+    void apply_change(decoded_change & change);
+
+    /// Writes the change, or buffers it in the service when apply batching is on.
+    void apply_row(otterbrix_service & service, const decoded_change & change);
+
+    /// Writes the buffered changes, moves result_lsn to the last commit among them
+    /// and releases the memory of the batch.
+    void flush_apply_batch();
+
+    /// Moves result_lsn to the commit the parallel applier has applied in order.
+    void sync_applied_lsn();
+
+    /// Drops the changes of a partial transaction, flushes the apply batch
+    /// and waits for the parallel applier to finish every committed transaction.
+    void drain_applier();
+
+    relation_ptr get_relation(int32_t table_id);
+
+    void open_stream();
+
+    /// Drops the replication connection; the server resends everything after the confirmed lsn,
+    /// so partially received streamed transactions start over. Polling calls it before every peek.
+    void reset_stream();
+
+    void start_pipeline();
+
+    void stop_pipeline();
+
+    /// Reads the replication connection and answers keepalives, the only thread that touches wal_stream.
+    void fetch_loop();
+
+    void decode_loop();
+
+    /// Standby status update, sent when forced or once per status_interval.
+    void send_status(uint64_t received_lsn, uint64_t flushed_lsn, bool force);
+
+    /// Feeds the last batch to the adaptive controller, publishes batch metrics and logs the registry
+    /// once per metrics_interval.
+    void adjust_batch_size();
+
+    uint64_t query_slot_lag();
+
     uint64_t get_lsn(const std::string & lsn);
 
     void update_lsn();
@@ -35,20 +150,96 @@ private:
     postgres_settings current_postgres_settings;
     const std::string replication_slot_name, publication_name;
     const std::string database_name;
+    const std::string connection_dsn;
+    const replication_settings settings;
+
+    /// Saved before every confirmation, a restart resumes from it instead of loading the tables again.
+    applied_lsn_file applied_state;
 
     bool is_committed = false;
 
+    /// Row changes of the transaction being received, the first open_change_count are in use.
+    std::vector<decoded_change> open_changes;
+    size_t open_change_count = 0;
+
+    /// Apply batching: commit whose changes are buffered but not written yet, 0 if none.
+    uint64_t pending_commit_lsn = 0;
+    std::chrono::steady_clock::time_point last_flush_time;
+
     std::shared_ptr<postgres::сonnection> connection;
+    postgres::replication_stream_ptr wal_stream;
+    std::chrono::steady_clock::time_point last_status_time;
+
+    /// Raw pgoutput bytes of the current message, reused between messages.
+    std::string message_buffer;
+
+    std::unique_ptr<logical_replication_parser> parser;
+    std::unique_ptr<transaction_spool> spool;
+    change_sink apply_sink;
+
+    /// Reused between messages so their row buffers keep their capacity.
+    decoded_change message_change, replay_change;
+
+    /// Parser output, owned by the decode side.
+    std::string decoded_lsn, decoded_commit_lsn;
+    bool decoded_commit = false;
+
+    std::unordered_map<int32_t, relation_ptr> relations;
+
+    struct raw_message {
+        std::string data;
+        uint64_t wal_start = 0;
+    };
+
+    std::unique_ptr<bounded_queue<raw_message>> fetch_queue;
+    std::unique_ptr<bounded_queue<decoded_change>> apply_queue;
+    std::thread fetch_thread, decode_thread;
+    std::atomic<bool> pipeline_stop{false};
+    std::atomic<uint64_t> applied_lsn{0};
+    std::atomic<uint64_t> stream_lag_bytes{0};
+
+    /// Concurrent initial load: tables still loading and their held changes, owned by the consuming thread.
+    std::unordered_set<std::string> held_tables;
+    std::unique_ptr<held_change_spool> held_changes;
+    bool confirmation_frozen = false;
+    bool held_changes_full = false;
+    std::function<void()> loads_applied;
+
+    /// Last commit applied while confirmation was frozen.
+    uint64_t held_lsn = 0;
+
+    /// End lsn of the last transaction applied or held. The server resends everything after the confirmed lsn
+    /// on a reconnect, transactions committed before this one are skipped.
+    uint64_t dispatched_lsn = 0;
+
+    /// Inserts and updates of transactions committed before it are upserts, 0 outside a resumed load.
+    uint64_t reconcile_lsn = 0;
+
+    /// Written by the loading thread.
+    std::mutex load_mutex;
+    std::condition_variable table_loaded;
+    std::vector<std::string> loaded_tables;
+    bool load_failed = false;
 
     std::unordered_map<int32_t, std::string> id_to_table_name;
     std::unordered_map<int32_t, std::vector<int32_t>> id_to_primary_key;
     std::unordered_set<int32_t> id_skip_table_name;
     std::unordered_map<int32_t, std::vector<std::pair<std::string, int32_t>>> id_table_to_column;
+    std::unordered_map<int32_t, std::vector<int32_t>> id_table_to_type_modifier;
 
     std::string current_lsn, result_lsn;
     uint64_t lsn_value;
 
     size_t max_block_size;
+    batch_size_controller batch_controller;
+
+    size_t batch_fetched = 0;
+    std::chrono::steady_clock::duration batch_apply_time{};
+    uint64_t slot_lag_bytes = 0;
+    std::chrono::steady_clock::time_point last_lag_check;
+    std::chrono::steady_clock::time_point last_metrics_time;
 
     otterbrix_service current_otterbrix_service;
+    std::vector<otterbrix_service> worker_services;
+    std::unique_ptr<parallel_applier> applier;
 };
@@ -1,12 +1,15 @@
 #pragma once
 
 #include <pqxx/pqxx>
+#include <functional>
 #include <future>
 
 #include <common/logger.h>
 #include <postgres/сonnection.h>
 #include <logical_replication/logical_replication_consumer.h>
+#include <logical_replication/snapshot_checkpoint.h>
 #include <common/scheduler.h>
+#include <common/memory_budget.h>
 
 namespace pqxx {
     using replication_transaction = transaction<repeatable_read, write_policy::read_only>;
@@ -29,42 +32,88 @@ public:
             std::vector<std::string> & tables_array_,
             size_t max_block_size_,
             bool user_managed_slot = false,
-            std::string user_snapshot = "");
+            std::string user_snapshot = "",
+            const replication_settings & settings_ = {});
 
     /// Start replication.
     void start_synchronization();
 
+    /// Consumes one batch on every shard, shards run on their own threads.
     bool run_consumer();
 
-    consumer_ptr get_consumer();
+    consumer_ptr get_consumer(size_t shard = 0);
+
+    size_t get_shard_count() const { return shards.size(); }
 
 private:
-    bool has_publication(pqxx::nontransaction & tx);
+    /// Tables replicated through one publication and slot by one consumer.
+    struct replication_shard {
+        std::vector<std::string> tables;
+        std::string tables_names;
+        std::string replication_slot;
+        std::string publication_name;
+        consumer_ptr consumer;
+
+        /// Concurrent snapshot: the initial load running while the consumer streams.
+        std::future<void> snapshot_load;
+    };
+
+    /// Publication, slot and initial load of one shard; the tables are read from the snapshot of its own slot.
+    void synchronize_shard(replication_shard & shard);
+
+    bool has_publication(pqxx::nontransaction & tx, const replication_shard & shard);
+
+    void create_publication(pqxx::nontransaction &tx, const replication_shard & shard);
+
+    bool has_replication_slot(pqxx::nontransaction & tx, const replication_shard & shard, std::string & start_lsn);
+
+    void create_replication_slot(pqxx::nontransaction & tx, const replication_shard & shard,
+                                 std::string & start_lsn, std::string & snapshot_name);
+
+    void drop_replication_slot(pqxx::nontransaction & tx, const replication_shard & shard);
+
+    /// Tables with their sizes, largest first; tables above snapshot_split_bytes become several ctid ranges.
+    std::vector<snapshot_task> plan_snapshot(postgres::сonnection & connection, const std::vector<std::string> & tables);
+
+    /// Loads the tasks of the checkpoint not done yet on up to snapshot_workers connections sharing the exported snapshot.
+    /// table_loaded is called once every task of a table is done.
+    void load_tables(postgres::сonnection & connection, snapshot_checkpoint & checkpoint, std::string & snapshot_name,
+                     const std::function<void(const std::string &)> & table_loaded = {});
 
-    void create_publication(pqxx::nontransaction &tx);
+    /// Whether an exported snapshot can still be imported, i.e. its exporting transaction is open.
+    bool is_snapshot_available(postgres::сonnection & connection, const std::string & snapshot_name);
 
-    bool has_replication_slot(pqxx::nontransaction & tx, std::string & start_lsn);
+    /// Whether every table has a primary key, to match rows that may be written twice.
+    bool has_primary_keys(const std::vector<std::string> & tables);
 
-    void create_replication_slot(pqxx::nontransaction & tx, std::string & start_lsn, std::string & snapshot_name);
+    /// Schema qualified name of the table, as pgoutput reports it.
+    std::string get_relation_name(pqxx::transaction_base & tx, const std::string & table_name);
 
-    void drop_replication_slot(pqxx::nontransaction & tx);
+    /// Column names and type OIDs in table order, type_modifiers gets the atttypmod of each.
+    std::vector<std::pair<std::string, int32_t>> get_table_columns(pqxx::transaction_base & tx,
+                                                                   const std::string & table_name,
+                                                                   std::vector<int32_t> & type_modifiers);
 
-    void load_from_snapshot(postgres::сonnection & connection, std::string & snapshot_name, const std::string &table_name);
+    /// Streams the table or its range with COPY in ctid order, after the task's resume bound, and writes it
+    /// in chunks of snapshot_chunk_rows documents, recording the ctid of the last row of every chunk in the checkpoint.
+    /// Rows of a replace task are written over the rows with the same primary key.
+    void load_from_snapshot(postgres::сonnection & connection, otterbrix_service & service,
+                            std::string & snapshot_name, const snapshot_task & task,
+                            size_t task_index, snapshot_checkpoint & checkpoint);
 
     std::string connection_dsn;
     logger current_logger;
 
     std::vector<std::string> tables_array;
     std::string database_name;
-    std::string tables_names;
 
     const bool user_managed_slot;
     const std::string user_snapshot;
-    const std::string replication_slot;
-    const std::string publication_name;
     size_t max_block_size;
+    const replication_settings settings;
 
-    consumer_ptr consumer;
+    /// Shared by the initial loads of all shards, outlives the concurrent loads of the shards.
+    memory_budget snapshot_budget;
 
-    otterbrix_service current_otterbrix_service;
+    std::vector<replication_shard> shards;
 };
@@ -7,8 +7,6 @@
 #include <logical_replication/logical_replication_consumer.h>
 #include <postgres/postgres_types.h>
 
-const std::string emptyValue = "NULL";
-
 class logical_replication_parser {
 public:
     logical_replication_parser(
@@ -17,30 +15,40 @@ public:
         bool *is_committed_,
         logger *logger_);
 
+    /// Streamed in-progress transaction (proto_version 2, streaming 'on'):
+    /// true between Stream Start and Stream Stop, changes there carry a sub-transaction xid.
+    bool in_stream() const { return stream_active; }
+
+    /// Replayed spool messages keep their xid prefix, the consumer marks them as streamed.
+    void set_stream_replay(bool replay) { stream_active = replay; }
+
+    /// Top level xid of the last Stream Start, Stream Commit or Stream Abort.
+    uint32_t get_stream_xid() const { return stream_xid; }
+
+    /// Aborted sub-transaction of the last Stream Abort, equal to the xid for the top level abort.
+    uint32_t get_stream_subxid() const { return stream_subxid; }
+
+    /// Commit lsn of the transaction being decoded, from its Begin or Stream Commit.
+    uint64_t get_transaction_lsn() const { return transaction_lsn; }
+
+    /// Parses one raw pgoutput message. For Update, old_value gets the 'K'/'O' tuple and stays empty without one.
     void parse_binary_data(const char *replication_message,
                          size_t size,
                          postgre_sql_type_operation &type_operation,
                          int32_t &table_id_query,
-                         std::vector<std::string> &result,
+                         replication_row &result,
                          std::unordered_map<int32_t, std::string> &id_to_table_name,
                          std::unordered_set<int32_t> &id_skip_table_name,
                          std::unordered_map<int32_t, std::vector<std::pair<std::string, int32_t>>> &id_table_to_column,
-                         std::unordered_map<int32_t, std::string>& old_value);
+                         std::unordered_map<int32_t, std::vector<int32_t>> &id_table_to_type_modifier,
+                         replication_row &old_value);
 
 private:
+    /// TupleData into row, value bytes are copied once into the row buffer.
     void parse_change_data(const char *message,
                          size_t &pos,
                          size_t size,
-                         std::vector<std::string> &result,
-                         std::unordered_map<int32_t, std::string> &old_result,
-                         bool old_value);
-
-    uint8_t hex_char_to_digit(char c);
-
-    uint8_t hex_2_char_to_digit(const char * data);
-
-    template<typename T>
-    T hex_n_char_to_t(const char * message, size_t pos, size_t n);
+                         replication_row &row);
 
     int8_t parse_int8(const char * message, size_t & pos, size_t size);
 
@@ -54,6 +62,11 @@ private:
 
     bool *is_committed;
 
+    bool stream_active = false;
+    uint32_t stream_xid = 0;
+    uint32_t stream_subxid = 0;
+    uint64_t transaction_lsn = 0;
+
     std::string *current_lsn, *result_lsn;
     logger *current_logger;
 };
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <common/logger.h>
+#include <logical_replication/decoded_change.h>
+
+/// Applies committed transactions on a pool of workers.
+/// A transaction waits only for earlier transactions that touch the same (table, primary key);
+/// tables without a primary key serialize against everything. The applied lsn moves forward
+/// in commit order, past a transaction only when all earlier ones are applied as well.
+class parallel_applier {
+public:
+    /// Applies the changes of one committed transaction.
+    using apply_function = std::function<void(size_t worker, const std::vector<decoded_change> & changes)>;
+
+    parallel_applier(size_t workers_, size_t max_in_flight_, apply_function apply_, logger *logger_);
+
+    /// Transactions not yet applied are dropped, the server resends them from the confirmed lsn.
+    ~parallel_applier();
+
+    /// Buffers the change; a change with commit_lsn closes the transaction and schedules it.
+    /// Blocks while max_in_flight transactions are pending.
+    void submit(decoded_change && change);
+
+    /// Drops the changes of the transaction being collected.
+    void discard_open_transaction();
+
+    /// Blocks until every scheduled transaction is applied.
+    void wait_idle();
+
+    uint64_t get_applied_lsn() const { return applied_lsn; }
+
+    size_t in_flight() const;
+
+private:
+    struct transaction {
+        uint64_t sequence = 0;
+        uint64_t commit_lsn = 0;
+        std::vector<decoded_change> changes;
+        std::vector<uint64_t> keys;
+        bool barrier = false;
+        bool done = false;
+        size_t pending_dependencies = 0;
+        std::vector<std::shared_ptr<transaction>> dependents;
+    };
+
+    using transaction_ptr = std::shared_ptr<transaction>;
+
+    /// Hashes of (table id, primary key values) of the row before and after the change.
+    /// Returns false when the row has no primary key.
+    static bool collect_keys(const decoded_change & change, std::vector<uint64_t> & keys);
+
+    void schedule(transaction_ptr txn);
+
+    void complete(const transaction_ptr & txn);
+
+    /// Moves applied_lsn past the applied prefix of pending; scheduler_mutex is held.
+    void release_applied();
+
+    void worker_loop(size_t worker);
+
+    const size_t max_in_flight;
+    apply_function apply;
+    logger *current_logger;
+
+    std::vector<decoded_change> open_changes;
+    uint64_t next_sequence = 0;
+
+    mutable std::mutex scheduler_mutex;
+    std::condition_variable ready_condition, capacity_condition, idle_condition;
+    std::deque<transaction_ptr> ready;
+    std::map<uint64_t, transaction_ptr> pending;
+    std::unordered_map<uint64_t, transaction_ptr> last_writer;
+    transaction_ptr last_barrier;
+    bool stopping = false;
+
+    std::atomic<uint64_t> applied_lsn{0};
+    std::vector<std::thread> workers;
+};
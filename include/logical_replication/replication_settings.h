@@ -0,0 +1,99 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+
+enum class replication_mode : uint8_t
+{
+    POLLING,   /// pg_logical_slot_peek_binary_changes + pg_replication_slot_advance
+    STREAMING  /// START_REPLICATION ... LOGICAL over the replication connection
+};
+
+struct adaptive_batch_settings {
+    bool enabled = false;
+    size_t min_block_size = 10;
+    size_t max_block_size = 100000;
+
+    /// Apply time of one batch the controller aims for.
+    std::chrono::milliseconds target_latency{500};
+
+    /// Slot lag above which the consumer is catching up and batches may grow quickly.
+    uint64_t catch_up_lag_bytes = 16 * 1024 * 1024;
+
+    /// Resident memory above which batches shrink, 0 disables the check.
+    size_t memory_limit_bytes = 0;
+
+    /// Polling mode: how often the slot lag is queried.
+    std::chrono::milliseconds lag_check_interval{5000};
+};
+
+struct replication_settings {
+    replication_mode mode = replication_mode::POLLING;
+
+    /// Ask pgoutput for column values in binary send format (proto_version 2, PostgreSQL 14+).
+    bool binary = false;
+
+    /// Ask pgoutput to stream large in-progress transactions (proto_version 2, PostgreSQL 14+).
+    /// Their changes are spooled to spool_directory and applied on Stream Commit.
+    bool streaming_transactions = false;
+    std::filesystem::path spool_directory = std::filesystem::temp_directory_path() / "logical_replication_spool";
+
+    /// Batch size follows apply latency, slot lag and memory use; max_block_size is the initial value.
+    adaptive_batch_settings adaptive_batch;
+
+    /// Streaming mode: how long consume() waits for new data before returning.
+    std::chrono::milliseconds wait_timeout{1000};
+
+    /// Streaming mode: maximum interval between standby status updates.
+    std::chrono::milliseconds status_interval{10000};
+
+    /// How often every consumer writes the metrics registry to the log, 0 disables.
+    std::chrono::seconds metrics_interval{60};
+
+    /// Streaming mode: fetch, decode and apply run on their own threads connected by bounded queues.
+    bool pipelined = false;
+
+    /// Capacity of each pipeline queue, in messages.
+    size_t pipeline_queue_size = 10000;
+
+    /// Transactions with disjoint primary keys are applied on this many workers, 1 applies serially.
+    size_t apply_workers = 1;
+
+    /// Parallel apply: committed transactions waiting or running before the consumer blocks.
+    size_t max_in_flight_transactions = 1000;
+
+    /// Changes of one table are written as one insert_many / delete_many, up to this many rows
+    /// over a group of transactions. 0 writes every change on its own.
+    size_t apply_batch_rows = 0;
+
+    /// Apply batching: a group of transactions is written at the latest this long after the previous one.
+    std::chrono::milliseconds apply_batch_delay{100};
+
+    /// Directory of the per-slot state files: progress of the initial load and the last applied lsn.
+    std::filesystem::path state_directory = std::filesystem::temp_directory_path() / "logical_replication_state";
+
+    /// Initial load: rows converted and written at a time, bounds the memory of a table load.
+    size_t snapshot_chunk_rows = 10000;
+
+    /// Initial load: connections loading tables at once, each importing the exported snapshot.
+    size_t snapshot_workers = 1;
+
+    /// Initial load: tables larger than this are split into ctid block ranges of about this size,
+    /// loaded by separate workers into the same collection. 0 disables splitting.
+    uint64_t snapshot_split_bytes = 0;
+
+    /// Initial load: estimated memory of the chunks loaded at once over all shards, 0 disables the limit.
+    size_t snapshot_memory_budget_bytes = 0;
+
+    /// Streaming mode: the consumer starts before the initial load and applies a table's changes
+    /// as soon as its load is done. Changes of tables still loading are held in spool_directory.
+    bool concurrent_snapshot = false;
+
+    /// Concurrent load: held changes above this size block the consumer until a table finishes, 0 disables the limit.
+    uint64_t held_changes_limit_bytes = 1024ull * 1024 * 1024;
+
+    /// Tables are split round-robin into this many groups, each with its own publication,
+    /// slot and consumer thread.
+    size_t shard_count = 1;
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <common/logger.h>
+
+/// One table, or one ctid range of a split table, of the initial load.
+struct snapshot_task {
+    std::string table_name;
+    uint64_t size_bytes = 0;
+
+    /// Estimated size of one chunk of rows, reserved from the snapshot memory budget.
+    uint64_t memory_bytes = 0;
+
+    /// ctid range of a split table, empty for the whole table.
+    std::string condition;
+
+    /// Rows already written.
+    uint64_t rows_done = 0;
+
+    /// ctid of the last row written, a resumed scan starts after it. Empty before the first chunk.
+    std::string resume_after;
+
+    /// Rows of the table were written under an older snapshot, the rest is written over them by primary key.
+    bool replace = false;
+    bool done = false;
+};
+
+/// Progress of the initial load of one slot, kept in a state file so a restart can continue it.
+/// The file is rewritten after every written chunk; an empty path disables it.
+class snapshot_checkpoint {
+public:
+    snapshot_checkpoint(std::filesystem::path path_, logger *logger_);
+
+    /// Reads the state file, false when there is none or it can not be parsed.
+    bool load();
+
+    /// Starts a new load, replacing the previous state. streamed_: the consumer applies changes while it runs.
+    void start(const std::string & slot_name_, const std::string & snapshot_name_,
+               const std::string & start_lsn_, std::vector<snapshot_task> tasks_, bool streamed_);
+
+    /// Continues the load under snapshot_name_. With a newer snapshot than the rows written so far were read from,
+    /// every table with written rows gets replace. Changes of transactions committed before reconcile_lsn_
+    /// may be in the tables already.
+    void resume(const std::string & snapshot_name_, bool newer_snapshot, uint64_t reconcile_lsn_);
+
+    /// Total rows of the task written so far and the ctid of the last one, called after the rows are flushed.
+    void chunk_done(size_t task, uint64_t rows, const std::string & last_ctid);
+
+    void task_done(size_t task, uint64_t rows);
+
+    /// Every task is done, a restart has nothing to continue.
+    void finish();
+
+    bool is_complete() const { return complete; }
+
+    const std::string & get_slot_name() const { return slot_name; }
+
+    const std::string & get_snapshot_name() const { return snapshot_name; }
+
+    const std::string & get_start_lsn() const { return start_lsn; }
+
+    /// Whether changes may have been applied before the load was done.
+    bool is_streamed() const { return streamed; }
+
+    uint64_t get_reconcile_lsn() const { return reconcile_lsn; }
+
+    const std::vector<snapshot_task> & get_tasks() const { return tasks; }
+
+private:
+    /// Writes a temporary file and renames it over the state file.
+    void save();
+
+    const std::filesystem::path path;
+    logger *current_logger;
+
+    std::mutex checkpoint_mutex;
+    std::string slot_name, snapshot_name, start_lsn;
+    std::vector<snapshot_task> tasks;
+    uint64_t reconcile_lsn = 0;
+    bool streamed = false;
+    bool complete = false;
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <common/logger.h>
+
+/// Disk-backed buffer of streamed in-progress transactions, one file per top level xid.
+/// Messages are stored as received, length-prefixed, and replayed in order on Stream Commit.
+class transaction_spool {
+public:
+    using message_handler = std::function<void(const char *message, size_t size)>;
+
+    transaction_spool(const std::filesystem::path & directory_, const std::string & prefix_, logger *logger_);
+
+    ~transaction_spool();
+
+    void append(uint32_t xid, uint32_t subxid, const char *message, size_t size);
+
+    /// Feeds every spooled message of xid to handler and removes the spool file.
+    void replay(uint32_t xid, const message_handler & handler);
+
+    /// Top level abort drops the whole transaction, sub-transaction abort truncates
+    /// the spool back to the first change of subxid.
+    void abort(uint32_t xid, uint32_t subxid);
+
+    size_t open_transactions() const { return files.size(); }
+
+private:
+    struct spool_file {
+        std::filesystem::path path;
+        std::ofstream stream;
+        uint64_t bytes = 0;
+        std::vector<std::pair<uint32_t, uint64_t>> subxid_offsets;
+    };
+
+    std::filesystem::path get_path(uint32_t xid) const;
+
+    void remove(uint32_t xid);
+
+    std::filesystem::path directory;
+    std::string prefix;
+    std::unordered_map<uint32_t, spool_file> files;
+    std::string read_buffer;
+    logger *current_logger;
+};
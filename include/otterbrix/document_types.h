@@ -16,6 +16,8 @@ enum class document_types : uint8_t
     STRING = 7,
     ARRAY = 8,
     DICT = 9,
+    DECIMAL = 10, // int128 scaled by 10^-scale
+    BINARY = 11, // raw bytes in a string value
     NA = 127, // NULL
     INVALID = 255,
 };
@@ -30,6 +32,8 @@ inline std::ostream& operator<<(std::ostream& os, document_types type) {
         {document_types::FLOAT, "FLOAT"},
         {document_types::DOUBLE, "DOUBLE"},
         {document_types::STRING, "STRING"},
+        {document_types::DECIMAL, "DECIMAL"},
+        {document_types::BINARY, "BINARY"},
         {document_types::NA, "NA"}, // NULL
         {document_types::INVALID, "INVALID"}};
 
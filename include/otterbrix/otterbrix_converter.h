@@ -6,36 +6,33 @@
 #include <memory_resource>
 #include <optional>
 #include <vector>
-#include <pqxx/pqxx>
 
 #include <otterbrix/document_types.h>
+#include <otterbrix/row_decoder.h>
+#include <postgres/postgres_types.h>
 
 #include <components/document/document.hpp>
+#include <components/logical_plan/param_storage.hpp>
 
 using namespace components::document;
 using namespace components;
 
 namespace tsl {
-    struct column_info {
-        document_types type;
-        std::string name;
-    };
-
-    struct doc_result {
-        std::vector<column_info> schema;
-        document_ptr document;
-    };
-
-    struct docs_result {
-        std::vector<column_info> schema;
-        std::vector<document_ptr> document;
-    };
-
-    doc_result logical_replication_to_docs(std::pmr::memory_resource *res, int16_t num_columns,
-                                           const std::vector<std::pair<std::string, int32_t> > &columns,
-                                           const std::vector<std::string> &result);
-
-    docs_result postgres_to_docs(std::pmr::memory_resource *res, const pqxx::result &result);
+    /// Document of one row, written column by column as the relation's decoder plan says.
+    components::document::document_ptr logical_replication_to_doc(std::pmr::memory_resource *res,
+                                                                  const row_decoder &decoder,
+                                                                  const replication_row &row);
+
+    /// Text form of a column value, binary values of the given type OID are rendered back to text.
+    /// Binary date, time and timestamps are rendered as the numbers documents store.
+    std::string value_to_string(const replication_value &value, int32_t type);
+
+    /// Binds a key value as the same native type logical_replication_to_doc stores for the column,
+    /// so matching compares typed values instead of text.
+    void add_key_parameter(const components::logical_plan::parameter_node_ptr &params,
+                           core::parameter_id_t id,
+                           const replication_value &value,
+                           const column_decoder &column);
 
     std::optional<std::vector<column_info>> merge_schemas(const std::vector<std::vector<column_info>>& schemas);
 }
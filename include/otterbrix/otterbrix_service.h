@@ -6,6 +6,7 @@
 #include <spdlog/spdlog.h>
 
 #include <postgres/postgres_types.h>
+#include <otterbrix/row_decoder.h>
 
 #include <components/expressions/key.hpp>
 #include <components/logical_plan/param_storage.hpp>
@@ -16,30 +17,104 @@ using id_par = core::parameter_id_t;
 
 class otterbrix_service {
 public:
-    std::shared_ptr<spdlog::logger> underlying_logger;
+    otterbrix_service();
+
+    otterbrix_service(otterbrix_service &&) noexcept;
+
+    ~otterbrix_service();
+
+    /// Releases the apply context; the next change creates a new one.
+    void shutdown();
 
     void data_handler(postgre_sql_type_operation type_operation,
                       const std::string &table_name,
                       const std::string &database_name,
                       const std::vector<int32_t> &primary_key,
-                      const std::vector<std::string> &result,
-                      const std::vector<std::pair<std::string, int32_t>> &columns,
-                      const std::unordered_map<int32_t, std::string> &old_value);
+                      const replication_row &result,
+                      const tsl::row_decoder &decoder,
+                      const replication_row &old_value);
 
-    void data_handler(pqxx::result &result,
-                      const std::string &table_name,
-                      const std::string &database_name);
+    /// Buffers the change until flush(). Inserts of one table become one insert_many, deletes one delete_many.
+    /// An update, or an operation of another kind on the same table, writes the table's batch first,
+    /// so the changes of every table keep their order.
+    void add_change(postgre_sql_type_operation type_operation,
+                    const std::string &table_name,
+                    const std::string &database_name,
+                    const std::vector<int32_t> &primary_key,
+                    const replication_row &result,
+                    const tsl::row_decoder &decoder,
+                    const replication_row &old_value);
+
+    /// Writes the row over the one with the same primary key, or inserts it when there is none,
+    /// for rows that may have been written already. The table's batch is written first.
+    void add_upsert(const std::string &table_name,
+                    const std::string &database_name,
+                    const std::vector<int32_t> &primary_key,
+                    const replication_row &result,
+                    const tsl::row_decoder &decoder);
+
+    /// Writes every buffered change and releases the batch arena holding the documents,
+    /// expressions and plan nodes built since the previous flush.
+    void flush();
+
+    size_t pending_changes() const;
 private:
+    /// Key column names of one row of a delete batch, the values are bound in the batch's parameter node.
+    using row_key = std::vector<std::string>;
+
+    struct table_batch;
+
+    struct match_template;
+
+    /// Memory resource, batches and the process-wide WAL writer, created on the first change and kept until shutdown.
+    /// Services on several threads share the writer, each WAL record is written under its lock.
+    struct apply_context;
+
+    apply_context & get_context();
+
+    std::unique_ptr<apply_context> context;
+
+    table_batch & get_batch(const std::string &database_name, const std::string &table_name);
+
+    void flush_batch(table_batch &batch);
+
+    /// update_one of result matched by the primary key, or by old_value when the message has it.
+    void write_update(const std::string &table_name,
+                      const std::string &database_name,
+                      const std::vector<int32_t> &primary_key,
+                      const replication_row &result,
+                      const tsl::row_decoder &decoder,
+                      const replication_row &old_value,
+                      bool upsert);
+
+    /// Primary key columns; without a primary key every non-null column of the row.
+    static void select_key_columns(const std::vector<int32_t> &primary_key,
+                                   const replication_row &row,
+                                   const tsl::row_decoder &decoder,
+                                   std::vector<int32_t> &key_columns);
+
+    /// Matches any of the rows: union_or of the per-row union_and of equalities,
+    /// parameter ids numbered in the order the rows were bound.
+    components::expressions::expression_ptr make_expression_match(std::pmr::memory_resource* resource,
+                                                                  const std::vector<row_key> &rows);
+
+    /// Match of one row by its key columns: the cached template of the table bound to the row's values.
+    /// Key columns are the primary key, or every non-null column of row when primary_key is empty
+    /// (old key 'K', old row 'O' or a table without a primary key).
     std::pair<components::expressions::expression_ptr,
     components::logical_plan::parameter_node_ptr> make_expression_match(
         std::pmr::memory_resource* resource,
+        const std::string &database_name,
+        const std::string &table_name,
         const std::vector<int32_t> &primary_key,
-        const std::vector<std::string> &result,
-        const std::vector<std::pair<std::string, int32_t>> &columns);
+        const replication_row &row,
+        const tsl::row_decoder &decoder);
 
-    std::pair<components::expressions::expression_ptr,
-    components::logical_plan::parameter_node_ptr> make_expression_match(
-    std::pmr::memory_resource* resource,
-    const std::unordered_map<int32_t, std::string> &old_value,
-    const std::vector<std::pair<std::string, int32_t>> &columns);
+    /// Flat union_and of key = id_par{i + 1} over the key columns, built once per table and key,
+    /// rebuilt when a Relation message renames the key columns. At most max_match_templates per table
+    /// are kept, the least recently used goes first.
+    const match_template & get_match_template(const std::string &database_name,
+                                              const std::string &table_name,
+                                              const std::vector<int32_t> &key_columns,
+                                              const tsl::row_decoder &decoder);
 };
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <otterbrix/document_types.h>
+
+namespace tsl {
+    struct column_info {
+        document_types type;
+        std::string name;
+
+        /// numeric(precision, scale) of a DECIMAL column.
+        int32_t precision = 0;
+        int32_t scale = 0;
+    };
+
+    /// How a column value is written into a document, chosen once from the type OID.
+    enum class column_op : uint8_t
+    {
+        INT16,
+        INT32,
+        INT64,
+        DECIMAL,
+        NUMERIC,
+        FLOAT,
+        DOUBLE,
+        BOOL,
+        STRING,
+        UUID,
+        BYTES,
+        DATE,
+        TIME,
+        TIMESTAMP,
+        JSON,
+        JSONB,
+        ARRAY,
+        UNSUPPORTED
+    };
+
+    struct column_decoder {
+        column_op op = column_op::UNSUPPORTED;
+
+        /// Element op of an array column.
+        column_op element_op = column_op::UNSUPPORTED;
+        int32_t type = 0;
+        std::string name;
+
+        /// DECIMAL values are unscaled int128s at this scale.
+        int32_t precision = 0;
+        int32_t scale = 0;
+    };
+
+    /// Decoder plan of one relation: one op per column in table order, built when the schema is received.
+    /// Columns of unsupported types fail when a row is decoded, not when the plan is built.
+    /// numeric(p, s) with p up to 38 is DECIMAL, plain numeric is NUMERIC and kept as its exact text.
+    /// uuid and bytea are raw bytes, date, time and timestamps numbers counted from the Unix epoch
+    /// (see postgres_datetime.h), json and jsonb nested documents.
+    struct row_decoder {
+        std::vector<column_decoder> columns;
+        std::vector<column_info> schema;
+
+        size_t size() const { return columns.size(); }
+
+        const column_decoder & operator[](size_t column) const { return columns[column]; }
+    };
+
+    /// type_modifiers are the attributes' typmods in the same order, numeric columns are NUMERIC without them.
+    row_decoder make_row_decoder(const std::vector<std::pair<std::string, int32_t>> &columns,
+                                 const std::vector<int32_t> &type_modifiers = {});
+}
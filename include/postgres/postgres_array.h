@@ -0,0 +1,202 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <fmt/format.h>
+
+#include <common/exception.h>
+#include <postgres/postgres_binary.h>
+
+/// Readers of array values. Both call a visitor as the elements are found, without collecting them:
+/// begin_array() and end_array() around every (sub-)array and element(value, is_null) for every element.
+namespace postgres::array
+{
+    /// PostgreSQL's own limit on array dimensions.
+    constexpr int32_t max_dimensions = 6;
+
+    inline bool is_space(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+    }
+
+    inline bool is_null_literal(std::string_view value) {
+        return value.size() == 4
+            && (value[0] | 0x20) == 'n' && (value[1] | 0x20) == 'u' && (value[2] | 0x20) == 'l' && (value[3] | 0x20) == 'l';
+    }
+
+    /// Array text format: optional [lower:upper] dimension decoration, nested {...} with ',' between elements,
+    /// double quoted elements, backslash escapes and unquoted NULL.
+    /// A plain unquoted element is a view into text; a quoted or escaped one is unescaped into buffer
+    /// and its view is valid until the next element.
+    template<typename Visitor>
+    void parse_text(std::string_view text, Visitor & visitor, std::string & buffer) {
+        size_t pos = 0;
+        auto fail = [&text](const char *reason) {
+            throw exception(error_codes::INVALID_INPUT, fmt::format("Invalid array literal, {}: {}", reason, text));
+        };
+        auto skip_spaces = [&]() {
+            while (pos < text.size() && is_space(text[pos]))
+                ++pos;
+        };
+        auto separator = [&]() {
+            skip_spaces();
+            if (pos < text.size() && text[pos] == ',')
+                ++pos;
+            else if (pos >= text.size() || text[pos] != '}')
+                fail("expected ',' or '}'");
+        };
+
+        if (!text.empty() && text[0] == '[') {
+            pos = text.find('=');
+            if (pos == std::string_view::npos)
+                fail("dimensions without '='");
+            ++pos;
+        }
+
+        skip_spaces();
+        if (pos >= text.size() || text[pos] != '{')
+            fail("expected '{'");
+        ++pos;
+        visitor.begin_array();
+
+        size_t depth = 1;
+        while (depth > 0) {
+            skip_spaces();
+            if (pos >= text.size())
+                fail("unterminated array");
+
+            const char c = text[pos];
+            if (c == '}') {
+                ++pos;
+                --depth;
+                visitor.end_array();
+                if (depth > 0)
+                    separator();
+                continue;
+            }
+            if (c == '{') {
+                if (depth == max_dimensions)
+                    fail("too many dimensions");
+                ++pos;
+                ++depth;
+                visitor.begin_array();
+                continue;
+            }
+
+            if (c == '"') {
+                buffer.clear();
+                for (++pos;; ++pos) {
+                    if (pos >= text.size())
+                        fail("unterminated quoted element");
+                    if (text[pos] == '"')
+                        break;
+                    if (text[pos] == '\\' && ++pos >= text.size())
+                        fail("unterminated escape");
+                    buffer += text[pos];
+                }
+                ++pos;
+                visitor.element(std::string_view(buffer), false);
+                separator();
+                continue;
+            }
+
+            // Unquoted: up to the next ',' or '}', trailing spaces are not part of it unless escaped
+            const size_t start = pos;
+            size_t end = pos;
+            bool escaped = false;
+            while (pos < text.size() && text[pos] != ',' && text[pos] != '}') {
+                if (text[pos] == '"' || text[pos] == '{')
+                    fail("unexpected character in element");
+                if (text[pos] == '\\') {
+                    if (pos + 1 >= text.size())
+                        fail("unterminated escape");
+                    escaped = true;
+                    pos += 2;
+                    end = pos;
+                    continue;
+                }
+                if (!is_space(text[pos]))
+                    end = pos + 1;
+                ++pos;
+            }
+
+            std::string_view element = text.substr(start, end - start);
+            if (!escaped) {
+                if (is_null_literal(element))
+                    visitor.element(std::string_view(), true);
+                else
+                    visitor.element(element, false);
+            } else {
+                buffer.clear();
+                for (size_t i = 0; i < element.size(); ++i) {
+                    if (element[i] == '\\')
+                        ++i;
+                    buffer += element[i];
+                }
+                visitor.element(std::string_view(buffer), false);
+            }
+            separator();
+        }
+
+        skip_spaces();
+        if (pos != text.size())
+            fail("characters after the array");
+    }
+
+    /// Array send format: ndim, has-null flag, element type OID, size and lower bound of every dimension,
+    /// then the elements in row-major order, each an int32 length (-1 for null) and its send format bytes.
+    template<typename Visitor>
+    void parse_binary(std::string_view value, Visitor & visitor) {
+        constexpr size_t header_size = 12;
+        if (value.size() < header_size)
+            throw exception(error_codes::INVALID_INPUT, "Invalid binary array length");
+
+        const int32_t dimensions = binary::read_be<int32_t>(value.data());
+        if (dimensions < 0 || dimensions > max_dimensions)
+            throw exception(error_codes::INVALID_INPUT, fmt::format("Invalid binary array dimensions: {}", dimensions));
+
+        size_t pos = header_size + 8 * static_cast<size_t>(dimensions);
+        if (value.size() < pos)
+            throw exception(error_codes::INVALID_INPUT, "Invalid binary array length");
+
+        int32_t sizes[max_dimensions];
+        for (int32_t dimension = 0; dimension < dimensions; ++dimension) {
+            sizes[dimension] = binary::read_be<int32_t>(value.data() + header_size + 8 * dimension);
+            if (sizes[dimension] < 0)
+                throw exception(error_codes::INVALID_INPUT, "Invalid binary array dimension size");
+        }
+
+        auto read_element = [&]() {
+            if (value.size() < pos + 4)
+                throw exception(error_codes::INVALID_INPUT, "Invalid binary array length");
+            const int32_t length = binary::read_be<int32_t>(value.data() + pos);
+            pos += 4;
+            if (length < 0) {
+                visitor.element(std::string_view(), true);
+                return;
+            }
+            if (value.size() - pos < static_cast<size_t>(length))
+                throw exception(error_codes::INVALID_INPUT, "Invalid binary array element length");
+            visitor.element(value.substr(pos, length), false);
+            pos += length;
+        };
+
+        auto read_dimension = [&](auto & self, int32_t dimension) -> void {
+            visitor.begin_array();
+            for (int32_t i = 0; i < sizes[dimension]; ++i) {
+                if (dimension + 1 < dimensions)
+                    self(self, dimension + 1);
+                else
+                    read_element();
+            }
+            visitor.end_array();
+        };
+
+        if (dimensions == 0) {
+            visitor.begin_array();
+            visitor.end_array();
+            return;
+        }
+        read_dimension(read_dimension, 0);
+    }
+}
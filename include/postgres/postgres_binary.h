@@ -0,0 +1,112 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <fmt/format.h>
+
+#include <common/exception.h>
+
+/// Helpers for values in network byte order, as sent by the walsender and pgoutput.
+namespace postgres::binary
+{
+    template<typename T>
+    inline T byte_swap(T value) {
+        if constexpr (sizeof(T) == 2) {
+            return static_cast<T>(__builtin_bswap16(static_cast<uint16_t>(value)));
+        } else if constexpr (sizeof(T) == 4) {
+            return static_cast<T>(__builtin_bswap32(static_cast<uint32_t>(value)));
+        } else if constexpr (sizeof(T) == 8) {
+            return static_cast<T>(__builtin_bswap64(static_cast<uint64_t>(value)));
+        } else {
+            return value;
+        }
+    }
+
+    template<typename T>
+    inline T read_be(const char *data) {
+        static_assert(std::is_integral_v<T>);
+        T value;
+        std::memcpy(&value, data, sizeof(T));
+        if constexpr (std::endian::native == std::endian::little) {
+            value = byte_swap(value);
+        }
+        return value;
+    }
+
+    template<typename T>
+    inline void write_be(char *data, T value) {
+        static_assert(std::is_integral_v<T>);
+        if constexpr (std::endian::native == std::endian::little) {
+            value = byte_swap(value);
+        }
+        std::memcpy(data, &value, sizeof(T));
+    }
+
+    /// int2/int4/int8 send format, the width is taken from the value length.
+    inline int64_t read_integer(std::string_view value) {
+        switch (value.size()) {
+            case 2: return read_be<int16_t>(value.data());
+            case 4: return read_be<int32_t>(value.data());
+            case 8: return read_be<int64_t>(value.data());
+            default:
+                throw exception(error_codes::INVALID_INPUT,
+                                fmt::format("Invalid binary integer length: {}", value.size()));
+        }
+    }
+
+    inline float read_float4(std::string_view value) {
+        if (value.size() != 4)
+            throw exception(error_codes::INVALID_INPUT, "Invalid binary float4 length");
+        return std::bit_cast<float>(read_be<uint32_t>(value.data()));
+    }
+
+    inline double read_float8(std::string_view value) {
+        if (value.size() != 8)
+            throw exception(error_codes::INVALID_INPUT, "Invalid binary float8 length");
+        return std::bit_cast<double>(read_be<uint64_t>(value.data()));
+    }
+
+    /// bool is one byte, bit/varbit is int32 bit length followed by the bits, the first bit is taken.
+    inline bool read_bool(std::string_view value) {
+        if (value.size() == 1)
+            return value[0] != 0;
+        if (value.size() > 4)
+            return read_be<int32_t>(value.data()) > 0 && (static_cast<uint8_t>(value[4]) & 0x80);
+        throw exception(error_codes::INVALID_INPUT, "Invalid binary bool length");
+    }
+
+    /// Lowercase hex digits of the bytes, two per byte.
+    inline std::string to_hex(std::string_view value) {
+        constexpr char digits[] = "0123456789abcdef";
+        std::string result;
+        result.reserve(2 * value.size());
+        for (char c : value) {
+            auto byte = static_cast<uint8_t>(c);
+            result += digits[byte >> 4];
+            result += digits[byte & 0x0F];
+        }
+        return result;
+    }
+
+    /// 16 raw bytes into the canonical xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx form.
+    inline std::string read_uuid(std::string_view value) {
+        if (value.size() != 16)
+            throw exception(error_codes::INVALID_INPUT, "Invalid binary uuid length");
+
+        constexpr char digits[] = "0123456789abcdef";
+        std::string result;
+        result.reserve(36);
+        for (size_t i = 0; i < 16; ++i) {
+            if (i == 4 || i == 6 || i == 8 || i == 10)
+                result += '-';
+            auto byte = static_cast<uint8_t>(value[i]);
+            result += digits[byte >> 4];
+            result += digits[byte & 0x0F];
+        }
+        return result;
+    }
+}
@@ -0,0 +1,212 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <string_view>
+#include <fmt/format.h>
+
+#include <common/exception.h>
+#include <postgres/postgres_binary.h>
+
+/// date, time, timestamp and timestamptz as numbers counted from the Unix epoch:
+/// date is int32 days since 1970-01-01, time is int64 microseconds since midnight,
+/// timestamp is int64 microseconds since 1970-01-01 00:00:00 and timestamptz the same in UTC.
+/// PostgreSQL's own epoch is 2000-01-01, binary values are shifted once here.
+namespace postgres::datetime
+{
+    constexpr int32_t postgres_epoch_days = 10957;
+    constexpr int64_t usecs_per_second = 1000000;
+    constexpr int64_t usecs_per_day = 86400 * usecs_per_second;
+
+    /// 'infinity' and '-infinity' keep PostgreSQL's values and are not shifted.
+    constexpr int32_t date_infinity = std::numeric_limits<int32_t>::max();
+    constexpr int32_t date_minus_infinity = std::numeric_limits<int32_t>::min();
+    constexpr int64_t timestamp_infinity = std::numeric_limits<int64_t>::max();
+    constexpr int64_t timestamp_minus_infinity = std::numeric_limits<int64_t>::min();
+
+    /// Days since 1970-01-01 of a proleptic Gregorian date, year 0 is 1 BC.
+    constexpr int64_t days_from_civil(int64_t year, int64_t month, int64_t day) {
+        year -= month <= 2;
+        const int64_t era = (year >= 0 ? year : year - 399) / 400;
+        const int64_t year_of_era = year - era * 400;
+        const int64_t day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+        const int64_t day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+        return era * 146097 + day_of_era - 719468;
+    }
+
+    /// Output of the ISO DateStyle, the default of every PostgreSQL connection.
+    class text_reader {
+    public:
+        text_reader(std::string_view text_, const char *type_)
+            : text(text_),
+              type(type_) {
+        }
+
+        [[noreturn]] void fail() const {
+            throw exception(error_codes::INVALID_INPUT, fmt::format("Invalid {}: {}", type, text));
+        }
+
+        bool at(char c) const { return pos < text.size() && text[pos] == c; }
+
+        bool at_end() const { return pos == text.size(); }
+
+        void expect(char c) {
+            if (!at(c))
+                fail();
+            ++pos;
+        }
+
+        int64_t number(size_t min_digits, size_t max_digits) {
+            int64_t result = 0;
+            size_t digits = 0;
+            for (; digits < max_digits && pos < text.size() && text[pos] >= '0' && text[pos] <= '9'; ++digits, ++pos)
+                result = result * 10 + (text[pos] - '0');
+            if (digits < min_digits)
+                fail();
+            return result;
+        }
+
+        /// YYYY-MM-DD, the year has 4 or more digits.
+        int64_t date() {
+            const int64_t year = number(4, 9);
+            expect('-');
+            const int64_t month = number(2, 2);
+            expect('-');
+            const int64_t day = number(2, 2);
+            if (month < 1 || month > 12 || day < 1 || day > 31)
+                fail();
+            last_date = {year, month, day};
+            return days_from_civil(year, month, day);
+        }
+
+        /// HH:MM:SS with up to 6 fraction digits.
+        int64_t time() {
+            const int64_t hours = number(2, 2);
+            expect(':');
+            const int64_t minutes = number(2, 2);
+            expect(':');
+            const int64_t seconds = number(2, 2);
+
+            int64_t fraction = 0;
+            if (at('.')) {
+                ++pos;
+                const size_t start = pos;
+                fraction = number(1, 6);
+                for (size_t digits = pos - start; digits < 6; ++digits)
+                    fraction *= 10;
+            }
+            if (minutes > 59 || seconds > 60 || hours * 3600 + minutes * 60 + seconds > 86400)
+                fail();
+            return (hours * 3600 + minutes * 60 + seconds) * usecs_per_second + fraction;
+        }
+
+        /// Optional +HH[:MM[:SS]] of timestamptz, in seconds east of UTC.
+        int64_t offset() {
+            if (!at('+') && !at('-'))
+                return 0;
+            const bool negative = text[pos++] == '-';
+            int64_t seconds = number(2, 2) * 3600;
+            if (at(':')) {
+                ++pos;
+                seconds += number(2, 2) * 60;
+            }
+            if (at(':')) {
+                ++pos;
+                seconds += number(2, 2);
+            }
+            return negative ? -seconds : seconds;
+        }
+
+        /// days of the last date() unless the text ends with " BC", year Y BC is year 1 - Y.
+        int64_t era_shift(int64_t days) {
+            if (text.substr(pos) != " BC")
+                return days;
+            pos = text.size();
+            return days_from_civil(1 - last_date.year, last_date.month, last_date.day);
+        }
+
+    private:
+        std::string_view text;
+        const char *type;
+        size_t pos = 0;
+
+        struct {
+            int64_t year = 0;
+            int64_t month = 0;
+            int64_t day = 0;
+        } last_date;
+    };
+
+    inline int32_t parse_date(std::string_view text) {
+        if (text == "infinity")
+            return date_infinity;
+        if (text == "-infinity")
+            return date_minus_infinity;
+
+        text_reader reader(text, "date");
+        const int64_t days = reader.era_shift(reader.date());
+        if (!reader.at_end())
+            reader.fail();
+        return static_cast<int32_t>(days);
+    }
+
+    inline int64_t parse_time(std::string_view text) {
+        text_reader reader(text, "time");
+        const int64_t usecs = reader.time();
+        if (!reader.at_end())
+            reader.fail();
+        return usecs;
+    }
+
+    /// timestamp, or timestamptz when the text has an offset.
+    inline int64_t parse_timestamp(std::string_view text) {
+        if (text == "infinity")
+            return timestamp_infinity;
+        if (text == "-infinity")
+            return timestamp_minus_infinity;
+
+        text_reader reader(text, "timestamp");
+        int64_t days = reader.date();
+        reader.expect(' ');
+        const int64_t usecs = reader.time();
+        const int64_t offset = reader.offset();
+        days = reader.era_shift(days);
+        if (!reader.at_end())
+            reader.fail();
+
+        int64_t result;
+        if (__builtin_mul_overflow(days, usecs_per_day, &result)
+            || __builtin_add_overflow(result, usecs - offset * usecs_per_second, &result))
+            reader.fail();
+        return result;
+    }
+
+    inline int32_t read_date(std::string_view value) {
+        if (value.size() != 4)
+            throw exception(error_codes::INVALID_INPUT, "Invalid binary date length");
+        const int32_t days = binary::read_be<int32_t>(value.data());
+        if (days == date_infinity || days == date_minus_infinity)
+            return days;
+        return days + postgres_epoch_days;
+    }
+
+    inline int64_t read_time(std::string_view value) {
+        if (value.size() != 8)
+            throw exception(error_codes::INVALID_INPUT, "Invalid binary time length");
+        return binary::read_be<int64_t>(value.data());
+    }
+
+    /// timestamp and timestamptz share the send format, timestamptz is in UTC.
+    inline int64_t read_timestamp(std::string_view value) {
+        if (value.size() != 8)
+            throw exception(error_codes::INVALID_INPUT, "Invalid binary timestamp length");
+        const int64_t usecs = binary::read_be<int64_t>(value.data());
+        if (usecs == timestamp_infinity || usecs == timestamp_minus_infinity)
+            return usecs;
+
+        int64_t result;
+        if (__builtin_add_overflow(usecs, postgres_epoch_days * usecs_per_day, &result))
+            throw exception(error_codes::INVALID_INPUT, "Timestamp out of range");
+        return result;
+    }
+}
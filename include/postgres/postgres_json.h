@@ -0,0 +1,253 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fmt/format.h>
+
+#include <common/exception.h>
+
+/// Reader of json and jsonb text. Like the array readers it calls a visitor as the values are found,
+/// without building a tree: begin_object()/end_object() and begin_array()/end_array() around containers,
+/// key(name) before every member value and string(value), number(text), boolean(value) or null() for scalars.
+namespace postgres::json
+{
+    /// jsonb send format is a version byte followed by the text form.
+    constexpr char jsonb_version = 1;
+
+    inline bool is_space(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    inline bool is_digit(char c) {
+        return c >= '0' && c <= '9';
+    }
+
+    inline void append_utf8(std::string & out, uint32_t code_point) {
+        if (code_point < 0x80) {
+            out += static_cast<char>(code_point);
+        } else if (code_point < 0x800) {
+            out += static_cast<char>(0xC0 | (code_point >> 6));
+            out += static_cast<char>(0x80 | (code_point & 0x3F));
+        } else if (code_point < 0x10000) {
+            out += static_cast<char>(0xE0 | (code_point >> 12));
+            out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code_point & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (code_point >> 18));
+            out += static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code_point & 0x3F));
+        }
+    }
+
+    /// A string without escapes is a view into text; an escaped one is unescaped into buffer
+    /// and its view is valid until the next string or key.
+    template<typename Visitor>
+    void parse(std::string_view text, Visitor & visitor, std::string & buffer) {
+        size_t pos = 0;
+        std::vector<char> containers;
+
+        auto fail = [&text](const char *reason) {
+            throw exception(error_codes::INVALID_INPUT, fmt::format("Invalid json, {}: {}", reason, text));
+        };
+        auto skip_spaces = [&]() {
+            while (pos < text.size() && is_space(text[pos]))
+                ++pos;
+        };
+        auto at = [&](char c) {
+            return pos < text.size() && text[pos] == c;
+        };
+        auto hex4 = [&]() {
+            if (text.size() - pos < 4)
+                fail("unterminated escape");
+            uint32_t value = 0;
+            for (size_t end = pos + 4; pos < end; ++pos) {
+                const char c = text[pos];
+                value <<= 4;
+                if (is_digit(c))
+                    value |= c - '0';
+                else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+                    value |= (c | 0x20) - 'a' + 10;
+                else
+                    fail("invalid unicode escape");
+            }
+            return value;
+        };
+
+        auto read_string = [&]() -> std::string_view {
+            const size_t start = ++pos;
+            while (pos < text.size() && text[pos] != '"' && text[pos] != '\\')
+                ++pos;
+            if (at('"'))
+                return text.substr(start, pos++ - start);
+
+            buffer.assign(text.substr(start, pos - start));
+            while (true) {
+                if (pos >= text.size())
+                    fail("unterminated string");
+                const char c = text[pos++];
+                if (c == '"')
+                    return buffer;
+                if (c != '\\') {
+                    buffer += c;
+                    continue;
+                }
+                if (pos >= text.size())
+                    fail("unterminated escape");
+                switch (text[pos++]) {
+                    case '"': buffer += '"'; break;
+                    case '\\': buffer += '\\'; break;
+                    case '/': buffer += '/'; break;
+                    case 'b': buffer += '\b'; break;
+                    case 'f': buffer += '\f'; break;
+                    case 'n': buffer += '\n'; break;
+                    case 'r': buffer += '\r'; break;
+                    case 't': buffer += '\t'; break;
+                    case 'u': {
+                        uint32_t code_point = hex4();
+                        if (code_point >= 0xD800 && code_point < 0xDC00) {
+                            if (text.substr(pos, 2) != "\\u")
+                                fail("unpaired surrogate");
+                            pos += 2;
+                            const uint32_t low = hex4();
+                            if (low < 0xDC00 || low > 0xDFFF)
+                                fail("unpaired surrogate");
+                            code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+                        }
+                        append_utf8(buffer, code_point);
+                        break;
+                    }
+                    default:
+                        fail("invalid escape");
+                }
+            }
+        };
+
+        // -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+        auto read_number = [&]() {
+            const size_t start = pos;
+            auto digits = [&]() {
+                const size_t first = pos;
+                while (pos < text.size() && is_digit(text[pos]))
+                    ++pos;
+                if (pos == first)
+                    fail("invalid number");
+            };
+            if (at('-'))
+                ++pos;
+            if (at('0'))
+                ++pos;
+            else
+                digits();
+            if (at('.')) {
+                ++pos;
+                digits();
+            }
+            if (at('e') || at('E')) {
+                ++pos;
+                if (at('+') || at('-'))
+                    ++pos;
+                digits();
+            }
+            visitor.number(text.substr(start, pos - start));
+        };
+
+        auto literal = [&](std::string_view word) {
+            if (text.substr(pos, word.size()) != word)
+                fail("invalid literal");
+            pos += word.size();
+        };
+
+        auto member_key = [&]() {
+            skip_spaces();
+            if (!at('"'))
+                fail("expected object key");
+            visitor.key(read_string());
+            skip_spaces();
+            if (!at(':'))
+                fail("expected ':'");
+            ++pos;
+        };
+
+        bool expect_value = true;
+        while (true) {
+            skip_spaces();
+            if (expect_value) {
+                if (pos >= text.size())
+                    fail("expected value");
+
+                expect_value = false;
+                switch (text[pos]) {
+                    case '{':
+                        ++pos;
+                        visitor.begin_object();
+                        skip_spaces();
+                        if (at('}')) {
+                            ++pos;
+                            visitor.end_object();
+                            break;
+                        }
+                        containers.push_back('}');
+                        member_key();
+                        expect_value = true;
+                        break;
+                    case '[':
+                        ++pos;
+                        visitor.begin_array();
+                        skip_spaces();
+                        if (at(']')) {
+                            ++pos;
+                            visitor.end_array();
+                            break;
+                        }
+                        containers.push_back(']');
+                        expect_value = true;
+                        break;
+                    case '"':
+                        visitor.string(read_string());
+                        break;
+                    case 't':
+                        literal("true");
+                        visitor.boolean(true);
+                        break;
+                    case 'f':
+                        literal("false");
+                        visitor.boolean(false);
+                        break;
+                    case 'n':
+                        literal("null");
+                        visitor.null();
+                        break;
+                    default:
+                        read_number();
+                        break;
+                }
+                continue;
+            }
+
+            // After a value: the next member or element, or the end of its container
+            if (containers.empty())
+                break;
+            if (at(',')) {
+                ++pos;
+                if (containers.back() == '}')
+                    member_key();
+                expect_value = true;
+                continue;
+            }
+            if (!at(containers.back()))
+                fail("expected ',' or the end of a container");
+            ++pos;
+            if (containers.back() == '}')
+                visitor.end_object();
+            else
+                visitor.end_array();
+            containers.pop_back();
+        }
+
+        if (pos != text.size())
+            fail("characters after the value");
+    }
+}
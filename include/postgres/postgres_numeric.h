@@ -0,0 +1,177 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <fmt/format.h>
+
+#include <common/exception.h>
+#include <postgres/postgres_binary.h>
+
+/// NUMERIC values as 128-bit integers scaled by a fixed number of decimal digits.
+namespace postgres::numeric
+{
+    using int128 = __int128;
+
+    /// Decimal digits an int128 holds at any value.
+    constexpr int32_t max_precision = 38;
+
+    /// Precision and scale of numeric(p, s), from the attribute's type modifier.
+    struct type_modifier {
+        int32_t precision = 0;
+        int32_t scale = 0;
+
+        /// Fits a 128-bit unscaled value; false for plain numeric, whose scale differs between values.
+        bool is_fixed() const { return precision > 0 && precision <= max_precision; }
+    };
+
+    /// typmod is ((precision << 16) | scale) + VARHDRSZ with an 11-bit signed scale, -1 without one.
+    inline type_modifier read_type_modifier(int32_t typmod) {
+        constexpr int32_t varhdrsz = 4;
+        if (typmod < varhdrsz)
+            return {};
+
+        const int32_t value = typmod - varhdrsz;
+        return {(value >> 16) & 0xFFFF, ((value & 0x7FF) ^ 1024) - 1024};
+    }
+
+    inline int128 power_of_ten(int32_t exponent) {
+        int128 result = 1;
+        for (int32_t i = 0; i < exponent; ++i)
+            result *= 10;
+        return result;
+    }
+
+    /// unscaled * 10^-from as a value scaled by 10^-to. Digits below the target scale are zero
+    /// for values that satisfy the column's type modifier.
+    inline int128 rescale(int128 unscaled, int32_t from, int32_t to) {
+        if (to < from)
+            return unscaled / power_of_ten(from - to);
+
+        int128 result;
+        if (to - from > max_precision || __builtin_mul_overflow(unscaled, power_of_ten(to - from), &result))
+            throw exception(error_codes::INVALID_INPUT, "Numeric value out of decimal range");
+        return result;
+    }
+
+    /// Text form: optional '-', digits and an optional fraction. The first 18 digits are summed in 64 bits.
+    inline int128 parse_text(std::string_view text, int32_t scale) {
+        size_t pos = 0;
+        const bool negative = !text.empty() && text[0] == '-';
+        if (negative)
+            ++pos;
+
+        uint64_t head = 0;
+        int128 unscaled = 0;
+        int32_t digits = 0, fraction_digits = 0;
+        bool fraction = false;
+        for (; pos < text.size(); ++pos) {
+            const char c = text[pos];
+            if (c == '.' && !fraction) {
+                fraction = true;
+                continue;
+            }
+            if (c < '0' || c > '9')
+                throw exception(error_codes::INVALID_INPUT, fmt::format("Invalid numeric: {}", text));
+
+            fraction_digits += fraction;
+            if (digits < 18) {
+                head = head * 10 + (c - '0');
+                unscaled = head;
+            } else if (__builtin_mul_overflow(unscaled, 10, &unscaled) || __builtin_add_overflow(unscaled, c - '0', &unscaled)) {
+                throw exception(error_codes::INVALID_INPUT, fmt::format("Numeric value out of decimal range: {}", text));
+            }
+            ++digits;
+        }
+        if (digits == 0)
+            throw exception(error_codes::INVALID_INPUT, fmt::format("Invalid numeric: {}", text));
+
+        unscaled = rescale(unscaled, fraction_digits, scale);
+        return negative ? -unscaled : unscaled;
+    }
+
+    struct binary_header {
+        int16_t ndigits;
+        int16_t weight;
+        uint16_t sign;
+        int16_t dscale;
+    };
+
+    /// Send format: ndigits, weight, sign, dscale and ndigits base 10000 digits, the first at 10000^weight.
+    inline binary_header read_header(std::string_view value) {
+        constexpr size_t header_size = 8;
+        if (value.size() < header_size)
+            throw exception(error_codes::INVALID_INPUT, "Invalid binary numeric length");
+
+        binary_header header{binary::read_be<int16_t>(value.data()), binary::read_be<int16_t>(value.data() + 2),
+                             binary::read_be<uint16_t>(value.data() + 4), binary::read_be<int16_t>(value.data() + 6)};
+        if (header.ndigits < 0 || value.size() < header_size + 2 * static_cast<size_t>(header.ndigits))
+            throw exception(error_codes::INVALID_INPUT, "Invalid binary numeric length");
+        return header;
+    }
+
+    constexpr uint16_t sign_negative = 0x4000;
+    constexpr uint16_t sign_special = 0xC000;
+
+    inline int16_t read_digit(std::string_view value, int32_t index) {
+        return binary::read_be<int16_t>(value.data() + 8 + 2 * index);
+    }
+
+    inline int128 read_binary(std::string_view value, int32_t scale) {
+        const binary_header header = read_header(value);
+        if ((header.sign & sign_special) == sign_special)
+            throw exception(error_codes::INVALID_INPUT, "NaN and infinity numeric can not be stored as decimal");
+
+        // Only the decimal digits down to 10^-scale are accumulated, so the intermediate never exceeds the result:
+        // the padding of the last fraction group is dropped instead of being divided away afterwards
+        constexpr int32_t group_powers[] = {1, 10, 100, 1000, 10000};
+        int128 unscaled = 0;
+        int32_t next_exponent = 4 * (header.weight + 1);
+        for (int32_t i = 0; i < header.ndigits; ++i) {
+            const int32_t kept = std::min(4, next_exponent + scale);
+            if (kept <= 0)
+                break;
+
+            if (__builtin_mul_overflow(unscaled, group_powers[kept], &unscaled)
+                || __builtin_add_overflow(unscaled, read_digit(value, i) / group_powers[4 - kept], &unscaled))
+                throw exception(error_codes::INVALID_INPUT, "Numeric value out of decimal range");
+            next_exponent -= kept;
+        }
+
+        // Trailing zero groups are not sent
+        unscaled = rescale(unscaled, 0, next_exponent + scale);
+        return header.sign == sign_negative ? -unscaled : unscaled;
+    }
+
+    /// Exact text of a binary value, as PostgreSQL prints it.
+    inline std::string binary_to_string(std::string_view value) {
+        const binary_header header = read_header(value);
+        if ((header.sign & sign_special) == sign_special) {
+            if (header.sign == sign_special)
+                return "NaN";
+            return header.sign == 0xD000 ? "Infinity" : "-Infinity";
+        }
+
+        auto digit = [&](int32_t index) -> int16_t {
+            return index >= 0 && index < header.ndigits ? read_digit(value, index) : 0;
+        };
+
+        std::string result;
+        if (header.sign == sign_negative)
+            result += '-';
+        if (header.weight < 0)
+            result += '0';
+        for (int32_t i = 0; i <= header.weight; ++i)
+            result += i == 0 ? fmt::format("{}", digit(i)) : fmt::format("{:04}", digit(i));
+
+        if (header.dscale > 0) {
+            result += '.';
+            std::string fraction;
+            for (int32_t i = header.weight + 1; static_cast<int32_t>(fraction.size()) < header.dscale; ++i)
+                fraction += fmt::format("{:04}", digit(i));
+            result.append(fraction, 0, header.dscale);
+        }
+        return result;
+    }
+}
@@ -1,8 +1,13 @@
 #pragma once
 
 #include <cstdint>
+#include <cstdio>
 #include <iostream>
+#include <string>
+#include <string_view>
 #include <unordered_map>
+#include <vector>
+#include <fmt/format.h>
 
 enum class postgre_sql_type_operation : uint8_t
 {
@@ -12,26 +17,98 @@ enum class postgre_sql_type_operation : uint8_t
     NOT_PROCESSED
 };
 
+/// Column value of a pgoutput TupleData message, a view into the replication_row it came from.
+struct replication_value {
+    std::string_view data;
+    /// 'n' - null, 'u' - unchanged TOAST, 't' - text, 'b' - binary (network byte order)
+    char kind = 'n';
+
+    bool is_binary() const { return kind == 'b'; }
+
+    /// Null or unchanged TOAST.
+    bool is_null() const { return kind != 't' && kind != 'b'; }
+};
+
+/// Column values of one TupleData: offsets into a byte buffer and a bitmap of columns without a value.
+/// reset() keeps the capacity, so a reused row does not allocate once it has seen the widest message.
+class replication_row {
+public:
+    /// All columns become null.
+    void reset(size_t columns) {
+        buffer.clear();
+        slots.assign(columns, slot{});
+        null_bits.assign((columns + 63) / 64, ~uint64_t{0});
+    }
+
+    void clear() { reset(0); }
+
+    /// kind 't' and 'b' copy the value bytes, 'n' and 'u' leave the column without a value.
+    void set(size_t column, char kind, const char *data, size_t size) {
+        slot & target = slots[column];
+        target.kind = kind;
+        if (kind != 't' && kind != 'b') {
+            target.offset = target.length = 0;
+            null_bits[column / 64] |= uint64_t{1} << (column % 64);
+            return;
+        }
+        target.offset = static_cast<uint32_t>(buffer.size());
+        target.length = static_cast<uint32_t>(size);
+        buffer.append(data, size);
+        null_bits[column / 64] &= ~(uint64_t{1} << (column % 64));
+    }
+
+    size_t size() const { return slots.size(); }
+
+    bool empty() const { return slots.empty(); }
+
+    /// Null or unchanged TOAST.
+    bool is_null(size_t column) const { return (null_bits[column / 64] >> (column % 64)) & 1; }
+
+    replication_value operator[](size_t column) const {
+        const slot & source = slots[column];
+        return {std::string_view(buffer.data() + source.offset, source.length), source.kind};
+    }
+
+private:
+    struct slot {
+        uint32_t offset = 0;
+        uint32_t length = 0;
+        char kind = 'n';
+    };
+
+    std::string buffer;
+    std::vector<slot> slots;
+    std::vector<uint64_t> null_bits;
+};
+
 enum class postgres_types : int32_t
 {
     BOOL = 16,
+    BYTEA = 17,
     CHAR = 18,
     INT8 = 20,
     INT2 = 21,
     INT4 = 23,
     TEXT = 25,
+    JSON = 114,
     FLOAT = 700,
     DOUBLE = 701,
     VARCHAR = 1043,
+    DATE = 1082,
+    TIME = 1083,
+    TIMESTAMP = 1114,
+    TIMESTAMPTZ = 1184,
     BIT = 1560,
     UUID = 2950,
     NUMERIC = 1700,
+    JSONB = 3802,
     ARRAY = -1
 };
 
 enum class postgres_array_types : int32_t
 {
     BOOL = 1000,
+    BYTEA = 1001,
     CHAR = 1002,
     INT8 = 1016,
     INT2 = 1005,
@@ -40,11 +117,29 @@ enum class postgres_array_types : int32_t
     FLOAT = 1021,
     DOUBLE = 1022,
     VARCHAR = 1015,
+    JSON = 199,
+    DATE = 1182,
+    TIME = 1183,
+    TIMESTAMP = 1115,
+    TIMESTAMPTZ = 1185,
     BIT = 1561,
     UUID = 2951,
     NUMERIC = 1231,
+    JSONB = 3807,
 };
 
+/// LSN in the textual form used by PostgreSQL: XXXXXXXX/XXXXXXXX
+inline uint64_t string_to_lsn(const std::string & lsn) {
+    uint32_t upper_half = 0;
+    uint32_t lower_half = 0;
+    std::sscanf(lsn.data(), "%X/%X", &upper_half, &lower_half);
+    return (static_cast<uint64_t>(upper_half) << 32) + lower_half;
+}
+
+inline std::string lsn_to_string(uint64_t lsn) {
+    return fmt::format("{:X}/{:X}", static_cast<uint32_t>(lsn >> 32), static_cast<uint32_t>(lsn));
+}
+
 static std::unordered_map<int32_t, postgres_types> str_to_document_types = {};
 
 inline static postgres_types get_enum(int32_t num_value) {
@@ -61,6 +156,13 @@ inline static postgres_types get_enum(int32_t num_value) {
         case static_cast<int32_t>(postgres_types::BIT): return postgres_types::BIT;
         case static_cast<int32_t>(postgres_types::UUID): return postgres_types::UUID;
         case static_cast<int32_t>(postgres_types::NUMERIC): return postgres_types::NUMERIC;
+        case static_cast<int32_t>(postgres_types::BYTEA): return postgres_types::BYTEA;
+        case static_cast<int32_t>(postgres_types::JSON): return postgres_types::JSON;
+        case static_cast<int32_t>(postgres_types::JSONB): return postgres_types::JSONB;
+        case static_cast<int32_t>(postgres_types::DATE): return postgres_types::DATE;
+        case static_cast<int32_t>(postgres_types::TIME): return postgres_types::TIME;
+        case static_cast<int32_t>(postgres_types::TIMESTAMP): return postgres_types::TIMESTAMP;
+        case static_cast<int32_t>(postgres_types::TIMESTAMPTZ): return postgres_types::TIMESTAMPTZ;
         default: break;
     }
 
@@ -76,6 +178,13 @@ inline static postgres_types get_enum(int32_t num_value) {
         case static_cast<int32_t>(postgres_array_types::VARCHAR):
         case static_cast<int32_t>(postgres_array_types::BIT):
         case static_cast<int32_t>(postgres_array_types::UUID):
+        case static_cast<int32_t>(postgres_array_types::BYTEA):
+        case static_cast<int32_t>(postgres_array_types::JSON):
+        case static_cast<int32_t>(postgres_array_types::JSONB):
+        case static_cast<int32_t>(postgres_array_types::DATE):
+        case static_cast<int32_t>(postgres_array_types::TIME):
+        case static_cast<int32_t>(postgres_array_types::TIMESTAMP):
+        case static_cast<int32_t>(postgres_array_types::TIMESTAMPTZ):
         case static_cast<int32_t>(postgres_array_types::NUMERIC): return postgres_types::ARRAY;
         default: break;
     }
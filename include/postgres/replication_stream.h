@@ -0,0 +1,67 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <libpq-fe.h>
+#include <boost/noncopyable.hpp>
+
+#include <common/logger.h>
+
+namespace postgres
+{
+    enum class stream_status : uint8_t
+    {
+        DATA,       /// XLogData frame, message points to the pgoutput payload
+        KEEPALIVE,  /// Primary keepalive, message.reply_requested may be set
+        TIMEOUT,    /// Nothing arrived within the timeout
+        END         /// Server finished COPY BOTH
+    };
+
+    struct replication_message {
+        uint64_t wal_start = 0;
+        uint64_t wal_end = 0;
+        int64_t send_time = 0;
+        bool reply_requested = false;
+        const char *data = nullptr;
+        size_t size = 0;
+    };
+
+    /// Walsender connection in COPY BOTH mode after START_REPLICATION ... LOGICAL.
+    /// Works on raw libpq because pqxx does not expose the replication sub-protocol.
+    class replication_stream : boost::noncopyable
+    {
+    public:
+        replication_stream(const std::string & connection_dsn_, logger *logger_);
+
+        ~replication_stream();
+
+        void start(const std::string & slot_name, uint64_t start_lsn, const std::string & options);
+
+        /// The returned message is valid until the next call of read() or close().
+        stream_status read(replication_message & message, std::chrono::milliseconds timeout);
+
+        void send_status(uint64_t written_lsn, uint64_t flushed_lsn, uint64_t applied_lsn, bool reply_requested = false);
+
+        void close();
+
+        bool is_started() const { return started; }
+
+    private:
+        void connect();
+
+        bool wait_readable(std::chrono::milliseconds timeout);
+
+        void release_buffer();
+
+        PGconn *connection = nullptr;
+        char *copy_buffer = nullptr;
+        bool started = false;
+
+        std::string connection_dsn;
+        logger *current_logger;
+    };
+
+    using replication_stream_ptr = std::unique_ptr<replication_stream>;
+}
@@ -0,0 +1,51 @@
+#include <fstream>
+#include <fmt/format.h>
+
+#include <logical_replication/applied_lsn_file.h>
+#include <postgres/postgres_types.h>
+#include <common/exception.h>
+
+applied_lsn_file::applied_lsn_file(const std::filesystem::path & directory_, const std::string & slot_name_, logger *logger_)
+    : path(directory_ / fmt::format("{}.lsn", slot_name_)),
+      current_logger(logger_) {
+}
+
+std::optional<uint64_t> applied_lsn_file::load() const {
+    std::ifstream input(path);
+    std::string lsn;
+    if (!input || !std::getline(input, lsn) || lsn.find('/') == std::string::npos) {
+        return std::nullopt;
+    }
+    return string_to_lsn(lsn);
+}
+
+void applied_lsn_file::save(uint64_t lsn) {
+    if (saved_lsn == lsn) {
+        return;
+    }
+
+    std::filesystem::create_directories(path.parent_path());
+    std::filesystem::path temporary_path = path;
+    temporary_path += ".tmp";
+    {
+        std::ofstream output(temporary_path, std::ios::trunc);
+        output << lsn_to_string(lsn) << '\n';
+        output.flush();
+        if (!output) {
+            throw exception(error_codes::LOGICAL_ERROR,
+                            fmt::format("Failed to write applied lsn file {}", temporary_path.string()));
+        }
+    }
+    std::filesystem::rename(temporary_path, path);
+    saved_lsn = lsn;
+}
+
+void applied_lsn_file::remove() {
+    std::error_code error;
+    std::filesystem::remove(path, error);
+    saved_lsn.reset();
+    if (error) {
+        current_logger->log_to_file(log_level::WARNING, fmt::format(
+                       "Cannot remove applied lsn file {}: {}", path.string(), error.message()));
+    }
+}
@@ -0,0 +1,43 @@
+#include <algorithm>
+#include <fmt/format.h>
+
+#include <logical_replication/batch_size_controller.h>
+#include <common/exception.h>
+
+batch_size_controller::batch_size_controller(size_t initial_block_size, const adaptive_batch_settings & settings_)
+    : settings(settings_),
+      current(settings_.min_block_size) {
+    // std::clamp needs ordered bounds
+    if (settings.min_block_size > settings.max_block_size) {
+        throw exception(error_codes::BAD_ARGUMENTS, fmt::format("Minimum batch size {} is above the maximum {}",
+                                                                settings.min_block_size, settings.max_block_size));
+    }
+    current = std::clamp(initial_block_size, settings.min_block_size, settings.max_block_size);
+}
+
+size_t batch_size_controller::update(size_t fetched,
+                                     std::chrono::microseconds apply_latency,
+                                     uint64_t lag_bytes,
+                                     size_t memory_bytes) {
+    const auto target = std::chrono::duration_cast<std::chrono::microseconds>(settings.target_latency);
+    const bool full_batch = fetched >= current;
+    const bool catching_up = lag_bytes >= settings.catch_up_lag_bytes;
+
+    size_t next = current;
+    if (settings.memory_limit_bytes && memory_bytes > settings.memory_limit_bytes) {
+        next = current / 2;
+    } else if (fetched > 0 && apply_latency > target) {
+        // Scale towards the target, but never more than halve at once
+        double ratio = static_cast<double>(target.count()) / static_cast<double>(apply_latency.count());
+        next = std::max(static_cast<size_t>(static_cast<double>(current) * ratio), current / 2);
+    } else if (full_batch && catching_up) {
+        next = current * 2;
+    } else if (full_batch && apply_latency < target / 2) {
+        next = current + current / 4 + 1;
+    } else if (fetched < current / 4 && !catching_up) {
+        next = current - current / 4;
+    }
+
+    current = std::clamp(next, settings.min_block_size, settings.max_block_size);
+    return current;
+}
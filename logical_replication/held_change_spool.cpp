@@ -0,0 +1,164 @@
+#include <fmt/format.h>
+
+#include <logical_replication/held_change_spool.h>
+#include <common/exception.h>
+
+namespace {
+    template<typename T>
+    void write_value(std::ofstream & stream, T value) {
+        stream.write(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    template<typename T>
+    T read_value(std::ifstream & stream) {
+        T value{};
+        stream.read(reinterpret_cast<char *>(&value), sizeof(value));
+        return value;
+    }
+}
+
+held_change_spool::held_change_spool(const std::filesystem::path & directory_, const std::string & prefix_, logger *logger_)
+    : directory(directory_),
+      prefix(prefix_),
+      current_logger(logger_) {
+    std::filesystem::create_directories(directory);
+
+    // Held changes are received again from the confirmed lsn, leftovers of a previous run are useless
+    for (const auto & entry : std::filesystem::directory_iterator(directory)) {
+        const std::string file_name = entry.path().filename().string();
+        if (entry.is_regular_file() && file_name.starts_with(prefix + "_") && entry.path().extension() == ".held") {
+            std::filesystem::remove(entry.path());
+        }
+    }
+}
+
+held_change_spool::~held_change_spool() {
+    for (auto & [table_name, file] : files) {
+        file.stream.close();
+        std::error_code error;
+        std::filesystem::remove(file.path, error);
+    }
+}
+
+void held_change_spool::append(const decoded_change & change) {
+    auto [it, inserted] = files.try_emplace(change.relation->table_name);
+    table_file & file = it->second;
+
+    if (inserted) {
+        file.path = directory / fmt::format("{}_{}.held", prefix, next_file++);
+        file.stream.open(file.path, std::ios::binary | std::ios::trunc);
+        current_logger->log_to_file(log_level::DEBUG, fmt::format(
+                       "Holding changes of {} until its initial load is done", change.relation->table_name));
+    }
+
+    if (file.relations.empty() || file.relations.back() != change.relation) {
+        file.relations.push_back(change.relation);
+    }
+
+    const uint64_t start = file.bytes;
+    write_value(file.stream, static_cast<uint32_t>(file.relations.size() - 1));
+    write_value(file.stream, static_cast<uint8_t>(change.type_operation));
+    write_value(file.stream, change.transaction_lsn);
+    file.bytes += sizeof(uint32_t) + sizeof(uint8_t) + sizeof(uint64_t);
+    write_row(file, change.result);
+    write_row(file, change.old_value);
+
+    if (!file.stream) {
+        throw exception(error_codes::LOGICAL_ERROR,
+                        fmt::format("Failed to write held changes file {}", file.path.string()));
+    }
+    total_bytes += file.bytes - start;
+    ++file.changes;
+}
+
+void held_change_spool::commit() {
+    for (auto & [table_name, file] : files) {
+        file.committed_bytes = file.bytes;
+        file.committed_changes = file.changes;
+    }
+}
+
+void held_change_spool::discard_uncommitted() {
+    for (auto & [table_name, file] : files) {
+        if (file.changes == file.committed_changes) {
+            continue;
+        }
+
+        file.stream.close();
+        std::filesystem::resize_file(file.path, file.committed_bytes);
+        file.stream.open(file.path, std::ios::binary | std::ios::app);
+        if (!file.stream) {
+            throw exception(error_codes::LOGICAL_ERROR,
+                            fmt::format("Failed to reopen held changes file {}", file.path.string()));
+        }
+
+        current_logger->log_to_file(log_level::DEBUG, fmt::format(
+                       "Dropped {} held changes of an unfinished transaction of {}",
+                       file.changes - file.committed_changes, table_name));
+        total_bytes -= file.bytes - file.committed_bytes;
+        file.bytes = file.committed_bytes;
+        file.changes = file.committed_changes;
+    }
+}
+
+void held_change_spool::write_row(table_file & file, const replication_row & row) {
+    write_value(file.stream, static_cast<uint32_t>(row.size()));
+    file.bytes += sizeof(uint32_t);
+    for (size_t column = 0; column < row.size(); ++column) {
+        const replication_value value = row[column];
+        write_value(file.stream, value.kind);
+        write_value(file.stream, static_cast<uint32_t>(value.data.size()));
+        file.stream.write(value.data.data(), static_cast<std::streamsize>(value.data.size()));
+        file.bytes += sizeof(char) + sizeof(uint32_t) + value.data.size();
+    }
+}
+
+void held_change_spool::read_row(std::ifstream & input, replication_row & row) {
+    auto columns = read_value<uint32_t>(input);
+    row.reset(columns);
+    for (uint32_t column = 0; column < columns; ++column) {
+        auto kind = read_value<char>(input);
+        auto length = read_value<uint32_t>(input);
+        value_buffer.resize(length);
+        input.read(value_buffer.data(), length);
+        row.set(column, kind, value_buffer.data(), value_buffer.size());
+    }
+}
+
+void held_change_spool::replay(const std::string & table_name, const change_handler & handler) {
+    auto it = files.find(table_name);
+    if (it == files.end()) {
+        return;
+    }
+
+    table_file & file = it->second;
+    file.stream.close();
+
+    std::ifstream input(file.path, std::ios::binary);
+    for (uint64_t change = 0; change < file.changes; ++change) {
+        auto relation = read_value<uint32_t>(input);
+        auto type_operation = read_value<uint8_t>(input);
+        auto transaction_lsn = read_value<uint64_t>(input);
+        read_row(input, replayed.result);
+        read_row(input, replayed.old_value);
+        if (!input || relation >= file.relations.size()) {
+            throw exception(error_codes::LOGICAL_ERROR,
+                            fmt::format("Truncated held changes file {}", file.path.string()));
+        }
+
+        replayed.relation = file.relations[relation];
+        replayed.type_operation = static_cast<postgre_sql_type_operation>(type_operation);
+        replayed.commit_lsn = 0;
+        replayed.transaction_lsn = transaction_lsn;
+        handler(replayed);
+    }
+
+    current_logger->log_to_file(log_level::INFO, fmt::format(
+                   "Replayed {} held changes of {}", file.changes, table_name));
+
+    input.close();
+    std::error_code error;
+    std::filesystem::remove(file.path, error);
+    total_bytes -= file.bytes;
+    files.erase(it);
+}
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <iostream>
 #include <fmt/format.h>
 #include <pqxx/pqxx>
@@ -6,6 +7,9 @@
 #include <logical_replication/logical_replication_consumer.h>
 #include <logical_replication/logical_replication_parser.h>
 #include <common/exception.h>
+#include <common/metrics.h>
+#include <common/hex_decoder.h>
+#include <postgres/postgres_binary.h>
 
 logical_replication_consumer::logical_replication_consumer(
     const std::string & connection_dsn_,
@@ -15,17 +19,71 @@ logical_replication_consumer::logical_replication_consumer(
     const std::string &publication_name_,
     const std::string &start_lsn,
     size_t max_block_size_,
-    logger *logger_)
+    logger *logger_,
+    const replication_settings & settings_)
     : current_logger(logger_),
       replication_slot_name(replication_slot_name_),
       publication_name(publication_name_),
       database_name(database_name_),
+      connection_dsn(connection_dsn_),
+      settings(settings_),
+      applied_state(settings_.state_directory, replication_slot_name_, logger_),
       connection(std::move(connection_)),
       current_lsn(start_lsn),
       result_lsn(start_lsn),
       lsn_value(get_lsn(start_lsn)),
       max_block_size(max_block_size_),
-      current_postgres_settings(connection_dsn_, logger_) {
+      batch_controller(max_block_size_, settings_.adaptive_batch),
+      current_postgres_settings(connection_dsn_, logger_),
+      parser(std::make_unique<logical_replication_parser>(&decoded_lsn, &decoded_commit_lsn, &decoded_commit, logger_)),
+      apply_sink([this](decoded_change && change) { dispatch_change(std::move(change)); }) {
+    if (settings.adaptive_batch.enabled)
+        max_block_size = batch_controller.get();
+
+    if (settings.streaming_transactions)
+        spool = std::make_unique<transaction_spool>(settings.spool_directory, replication_slot_name, logger_);
+
+    last_flush_time = std::chrono::steady_clock::now();
+    last_metrics_time = last_flush_time;
+
+    if (settings.apply_workers > 1)
+    {
+        worker_services.resize(settings.apply_workers);
+        applier = std::make_unique<parallel_applier>(
+            settings.apply_workers, settings.max_in_flight_transactions,
+            [this](size_t worker, const std::vector<decoded_change> & changes)
+            {
+                otterbrix_service & service = worker_services[worker];
+                for (const auto & change : changes)
+                    apply_row(service, change);
+
+                try
+                {
+                    service.flush();
+                }
+                catch (const std::exception &e)
+                {
+                    current_logger->log_to_file(log_level::ERROR, fmt::format("Error during apply: {}", e.what()));
+                }
+            },
+            logger_);
+    }
+
+    if (settings.mode == replication_mode::POLLING)
+        current_logger->log_to_file(log_level::DEBUG, fmt::format("Hex decoder: {}", hex::implementation()));
+
+    if (settings.pipelined && settings.mode != replication_mode::STREAMING)
+        current_logger->log_to_file(log_level::WARNING, "Pipelined consume requires streaming mode, changes are applied sequentially");
+}
+
+logical_replication_consumer::~logical_replication_consumer()
+{
+    stop_pipeline();
+    applier.reset();
+
+    current_otterbrix_service.shutdown();
+    for (auto & service : worker_services)
+        service.shutdown();
 }
 
 uint64_t logical_replication_consumer::get_lsn(const std::string & lsn)
@@ -51,6 +109,8 @@ void logical_replication_consumer::update_lsn()
 }
 
 std::string logical_replication_consumer::lsn(std::shared_ptr<pqxx::nontransaction> tx) {
+    applied_state.save(get_lsn(result_lsn));
+
     std::string query_str = fmt::format("SELECT end_lsn FROM pg_replication_slot_advance('{}', '{}')",
                                         replication_slot_name, result_lsn);
     pqxx::result result{tx->exec(query_str)};
@@ -78,23 +138,785 @@ std::vector<int32_t> logical_replication_consumer::get_primary_key(int32_t table
     return id_to_primary_key[table_id];
 }
 
+relation_ptr logical_replication_consumer::get_relation(int32_t table_id) {
+    auto it = relations.find(table_id);
+    if (it != relations.end()) {
+        return it->second;
+    }
+
+    auto relation = std::make_shared<relation_info>();
+    relation->table_id = table_id;
+    relation->table_name = id_to_table_name[table_id];
+    relation->columns = id_table_to_column[table_id];
+    relation->primary_key = get_primary_key(table_id);
+    relation->decoder = tsl::make_row_decoder(relation->columns, id_table_to_type_modifier[table_id]);
+    relations[table_id] = relation;
+    return relation;
+}
+
+std::vector<std::pair<std::string, std::string>> logical_replication_consumer::plugin_options() const
+{
+    std::vector<std::pair<std::string, std::string>> options;
+    options.emplace_back("proto_version", settings.binary || settings.streaming_transactions ? "2" : "1");
+    options.emplace_back("publication_names", publication_name);
+    if (settings.binary)
+        options.emplace_back("binary", "true");
+    if (settings.streaming_transactions)
+        options.emplace_back("streaming", "on");
+
+    return options;
+}
+
+void logical_replication_consumer::hold_tables(const std::vector<std::string> & table_names,
+                                               std::function<void()> loads_applied_)
+{
+    loads_applied = std::move(loads_applied_);
+    if (table_names.empty())
+    {
+        applied_state.save(get_lsn(result_lsn));
+        loads_applied();
+        return;
+    }
+
+    held_tables.insert(table_names.begin(), table_names.end());
+    held_changes = std::make_unique<held_change_spool>(settings.spool_directory, replication_slot_name, current_logger);
+    confirmation_frozen = true;
+}
+
+void logical_replication_consumer::reconcile_until(uint64_t lsn)
+{
+    reconcile_lsn = lsn;
+    current_logger->log_to_file(log_level::INFO, fmt::format(
+                   "Inserts and updates of transactions before {} are written by primary key", lsn_to_string(lsn)));
+}
+
+void logical_replication_consumer::finish_table_load(const std::string & table_name)
+{
+    {
+        std::lock_guard guard(load_mutex);
+        loaded_tables.push_back(table_name);
+    }
+    table_loaded.notify_all();
+}
+
+void logical_replication_consumer::abandon_table_loads()
+{
+    {
+        std::lock_guard guard(load_mutex);
+        load_failed = true;
+    }
+    table_loaded.notify_all();
+}
+
 bool logical_replication_consumer::consume()
 {
+    batch_fetched = 0;
+    batch_apply_time = {};
+
+    if (confirmation_frozen)
+        replay_loaded_tables();
+
+    bool has_data;
+    if (settings.mode == replication_mode::POLLING)
+        has_data = consume_polling();
+    else if (settings.pipelined)
+        has_data = consume_pipelined();
+    else
+        has_data = consume_streaming();
+
+    adjust_batch_size();
+    return has_data;
+}
+
+uint64_t logical_replication_consumer::query_slot_lag()
+{
+    try
+    {
+        pqxx::nontransaction tx(connection->get_ref());
+        std::string query_str = fmt::format(
+            "SELECT (pg_current_wal_lsn() - confirmed_flush_lsn)::bigint FROM pg_replication_slots WHERE slot_name = '{}'",
+            replication_slot_name);
+        pqxx::result result{tx.exec(query_str)};
+
+        if (!result.empty() && !result[0][0].is_null())
+            return std::max<int64_t>(result[0][0].as<int64_t>(), 0);
+    }
+    catch (const std::exception &e)
+    {
+        current_logger->log_to_file(log_level::WARNING, fmt::format("Cannot query slot lag: {}", e.what()));
+    }
+    return slot_lag_bytes;
+}
+
+void logical_replication_consumer::adjust_batch_size()
+{
+    auto apply_latency = std::chrono::duration_cast<std::chrono::microseconds>(batch_apply_time);
+
+    if (settings.mode == replication_mode::POLLING)
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_lag_check >= settings.adaptive_batch.lag_check_interval)
+        {
+            slot_lag_bytes = query_slot_lag();
+            last_lag_check = now;
+        }
+    }
+
+    size_t memory_bytes = metrics::resident_memory_bytes();
+
+    if (settings.adaptive_batch.enabled)
+    {
+        size_t next_block_size = batch_controller.update(batch_fetched, apply_latency, slot_lag_bytes, memory_bytes);
+        if (next_block_size != max_block_size)
+        {
+            current_logger->log_to_file(log_level::DEBUG, fmt::format(
+                           "Batch size {} -> {}, fetched: {}, apply: {} us, lag: {} bytes",
+                           max_block_size, next_block_size, batch_fetched, apply_latency.count(), slot_lag_bytes));
+            max_block_size = next_block_size;
+        }
+    }
+
+    auto & registry = metrics::instance();
+    registry.set_gauge(replication_slot_name + ".batch_size", static_cast<int64_t>(max_block_size));
+    registry.set_gauge(replication_slot_name + ".batch_fetched", static_cast<int64_t>(batch_fetched));
+    registry.set_gauge(replication_slot_name + ".apply_latency_us", apply_latency.count());
+    registry.set_gauge(replication_slot_name + ".slot_lag_bytes", static_cast<int64_t>(slot_lag_bytes));
+    registry.set_gauge("process.resident_memory_bytes", static_cast<int64_t>(memory_bytes));
+
+    auto now = std::chrono::steady_clock::now();
+    if (settings.metrics_interval.count() > 0 && now - last_metrics_time >= settings.metrics_interval)
+    {
+        last_metrics_time = now;
+        current_logger->log_to_file(log_level::INFO, fmt::format("Metrics of slot {}:\n{}",
+                                                                 replication_slot_name, registry.to_string()));
+    }
+}
+
+void logical_replication_consumer::process_message(const char *message, size_t size, const change_sink & sink)
+{
+    if (size == 0)
+        return;
+
+    const char type = message[0];
+    const bool stream_control = type == 'S' || type == 'E' || type == 'c' || type == 'A';
+
+    try
+    {
+        if (parser->in_stream() && !stream_control)
+        {
+            if (size < 5)
+                throw exception(error_codes::LOGICAL_ERROR, "Streamed message without xid");
+
+            spool->append(parser->get_stream_xid(), postgres::binary::read_be<uint32_t>(message + 1), message, size);
+            return;
+        }
+
+        bool has_change = decode_message(message, size, message_change);
+
+        if (type == 'c')
+        {
+            parser->set_stream_replay(true);
+            spool->replay(parser->get_stream_xid(), [this, &sink](const char *spooled, size_t spooled_size) {
+                if (decode_message(spooled, spooled_size, replay_change))
+                    sink(std::move(replay_change));
+            });
+            parser->set_stream_replay(false);
+        }
+        else if (type == 'A')
+        {
+            spool->abort(parser->get_stream_xid(), parser->get_stream_subxid());
+        }
+
+        // Stream Commit goes after the replayed changes it acknowledges
+        if (has_change)
+            sink(std::move(message_change));
+    }
+    catch (const exception &e)
+    {
+        parser->set_stream_replay(false);
+        current_logger->log_to_file(log_level::ERROR, fmt::format("Error during streamed transaction: {}", e.what()));
+    }
+}
+
+bool logical_replication_consumer::decode_message(const char *message, size_t size, decoded_change & change)
+{
+    change.type_operation = postgre_sql_type_operation::NOT_PROCESSED;
+    change.relation.reset();
+    change.result.clear();
+    change.old_value.clear();
+    change.commit_lsn = 0;
+    change.transaction_lsn = 0;
+
+    int32_t table_id_query = 0;
+    try
+    {
+        parser->parse_binary_data(message,
+                               size,
+                               change.type_operation,
+                               table_id_query,
+                               change.result,
+                               id_to_table_name,
+                               id_skip_table_name,
+                               id_table_to_column,
+                               id_table_to_type_modifier,
+                               change.old_value);
+    }
+    catch (const exception &e)
+    {
+        current_logger->log_to_file(log_level::ERROR, fmt::format("Error during parsing: {}", e.what()));
+        change.type_operation = postgre_sql_type_operation::NOT_PROCESSED;
+    }
+
+    if (message[0] == 'R')
+    {
+        // Columns may have changed, changes already decoded keep the old snapshot
+        relations.erase(table_id_query);
+        id_to_primary_key.erase(table_id_query);
+    }
+
+    if (decoded_commit)
+    {
+        change.commit_lsn = get_lsn(decoded_commit_lsn);
+        decoded_commit = false;
+    }
+    change.transaction_lsn = parser->get_transaction_lsn();
+
+    if (change.type_operation != postgre_sql_type_operation::NOT_PROCESSED)
+        change.relation = get_relation(table_id_query);
+
+    return change.type_operation != postgre_sql_type_operation::NOT_PROCESSED || change.commit_lsn != 0;
+}
+
+void logical_replication_consumer::dispatch_change(decoded_change && change)
+{
+    // Sent again after a reconnect, while confirmation is frozen that is everything since the snapshot
+    if (change.transaction_lsn != 0 && change.transaction_lsn < dispatched_lsn)
+        return;
+
+    const uint64_t commit_lsn = change.commit_lsn;
+
+    // Row changes only, commits pass so the rest of the transaction is applied
+    if (!held_tables.empty() && change.relation && held_tables.contains(change.relation->table_name))
+        hold_change(change);
+    else if (applier)
+        applier->submit(std::move(change));
+    else
+        apply_change(change);
+
+    if (commit_lsn != 0)
+    {
+        dispatched_lsn = commit_lsn;
+        if (held_changes)
+            held_changes->commit();
+    }
+}
+
+void logical_replication_consumer::hold_change(const decoded_change & change)
+{
+    held_changes->append(change);
+}
+
+bool logical_replication_consumer::can_read_changes()
+{
+    auto below_limit = [this] {
+        return !held_changes || settings.held_changes_limit_bytes == 0
+            || held_changes->bytes() <= settings.held_changes_limit_bytes;
+    };
+    if (below_limit())
+    {
+        held_changes_full = false;
+        return true;
+    }
+
+    if (!held_changes_full)
+        current_logger->log_to_file(log_level::WARNING, fmt::format(
+                       "Held changes of loading tables reached {} bytes, reading is paused until a load finishes",
+                       held_changes->bytes()));
+    held_changes_full = true;
+
+    bool failed;
+    {
+        std::unique_lock lock(load_mutex);
+        table_loaded.wait_for(lock, settings.wait_timeout, [this] { return !loaded_tables.empty() || load_failed; });
+        failed = load_failed;
+    }
+
+    // consume() stops the consumer
+    if (failed)
+        return false;
+
+    replay_loaded_tables();
+    return below_limit();
+}
+
+void logical_replication_consumer::replay_loaded_tables()
+{
+    std::vector<std::string> tables;
+    bool failed;
+    {
+        std::lock_guard guard(load_mutex);
+        tables.swap(loaded_tables);
+        failed = load_failed;
+    }
+
+    // Streaming on would confirm nothing and keep the slot's WAL without limit
+    if (failed)
+        throw exception(error_codes::LOGICAL_ERROR, fmt::format(
+                        "Initial load for slot {} failed, its confirmed lsn stays at the snapshot to load the tables again",
+                        replication_slot_name));
+
+    bool replayed = false;
+    for (const std::string & table_name : tables)
+    {
+        if (!held_tables.erase(table_name))
+            continue;
+
+        // Changes of other tables are not reordered against these, the parallel applier can keep running
+        held_changes->replay(table_name, [this](const decoded_change & change) {
+            apply_row(current_otterbrix_service, change);
+        });
+        replayed = true;
+        current_logger->log_to_file(log_level::INFO, fmt::format(
+                       "Table {} is loaded, applying its changes from the stream", table_name));
+    }
+
+    if (replayed)
+        flush_apply_batch();
+
+    if (!held_tables.empty())
+        return;
+
+    // Every change since the snapshot is applied, the commits seen meanwhile can be confirmed.
+    // A restart from here on resumes from the applied lsn instead of continuing the load
+    held_changes.reset();
+    applied_state.save(std::max(held_lsn, get_lsn(result_lsn)));
+    loads_applied();
+    confirmation_frozen = false;
+    if (held_lsn != 0)
+        advance_result_lsn(held_lsn);
+    held_lsn = 0;
+}
+
+void logical_replication_consumer::advance_result_lsn(uint64_t lsn)
+{
+    if (confirmation_frozen)
+    {
+        held_lsn = std::max(held_lsn, lsn);
+        return;
+    }
+
+    result_lsn = lsn_to_string(lsn);
+    is_committed = true;
+}
+
+void logical_replication_consumer::apply_change(decoded_change & change)
+{
+    const uint64_t commit_lsn = change.commit_lsn;
+
+    // Rows are written once their Commit arrives: a transaction torn by a reconnect is sent again in full.
+    // Swapping keeps the row buffers of both sides for the next messages
+    if (change.type_operation != postgre_sql_type_operation::NOT_PROCESSED)
+    {
+        if (open_change_count == open_changes.size())
+            open_changes.emplace_back();
+        std::swap(open_changes[open_change_count++], change);
+    }
+
+    if (commit_lsn == 0)
+        return;
+
+    for (size_t i = 0; i < open_change_count; ++i)
+        apply_row(current_otterbrix_service, open_changes[i]);
+    open_change_count = 0;
+
+    if (settings.apply_batch_rows == 0)
+    {
+        advance_result_lsn(commit_lsn);
+        return;
+    }
+
+    pending_commit_lsn = commit_lsn;
+    if (current_otterbrix_service.pending_changes() >= settings.apply_batch_rows
+        || std::chrono::steady_clock::now() - last_flush_time >= settings.apply_batch_delay)
+        flush_apply_batch();
+}
+
+void logical_replication_consumer::apply_row(otterbrix_service & service, const decoded_change & change)
+{
+    try
+    {
+        const relation_info & relation = *change.relation;
+        // Replayed from the slot over a resumed load: the row may be there already, or missing when
+        // a newer snapshot read it in a range done before. Inserts and updates write it by primary key,
+        // an update that changed the key removes the old one first. Deletes match nothing when it is gone
+        if (change.transaction_lsn < reconcile_lsn && !relation.primary_key.empty()
+            && (change.type_operation == postgre_sql_type_operation::INSERT
+                || change.type_operation == postgre_sql_type_operation::UPDATE))
+        {
+            if (!change.old_value.empty())
+                service.add_change(postgre_sql_type_operation::DELETE, relation.table_name, database_name,
+                                   relation.primary_key, change.old_value, relation.decoder, {});
+            service.add_upsert(relation.table_name, database_name, relation.primary_key, change.result,
+                               relation.decoder);
+        }
+        else if (settings.apply_batch_rows > 0)
+            service.add_change(change.type_operation, relation.table_name, database_name,
+                               relation.primary_key, change.result,
+                               relation.decoder, change.old_value);
+        else
+            service.data_handler(change.type_operation, relation.table_name, database_name,
+                                 relation.primary_key, change.result,
+                                 relation.decoder, change.old_value);
+    }
+    catch (const std::exception &e)
+    {
+        current_logger->log_to_file(log_level::ERROR, fmt::format("Error during apply: {}", e.what()));
+    }
+}
+
+void logical_replication_consumer::flush_apply_batch()
+{
+    try
+    {
+        current_otterbrix_service.flush();
+    }
+    catch (const std::exception &e)
+    {
+        current_logger->log_to_file(log_level::ERROR, fmt::format("Error during apply: {}", e.what()));
+    }
+    last_flush_time = std::chrono::steady_clock::now();
+
+    if (pending_commit_lsn != 0)
+    {
+        advance_result_lsn(pending_commit_lsn);
+        pending_commit_lsn = 0;
+    }
+}
+
+void logical_replication_consumer::sync_applied_lsn()
+{
+    if (!applier)
+        return;
+
+    uint64_t lsn = applier->get_applied_lsn();
+    if (lsn > get_lsn(result_lsn))
+        advance_result_lsn(lsn);
+}
+
+void logical_replication_consumer::send_status(uint64_t received_lsn, uint64_t flushed_lsn, bool force)
+{
+    auto now = std::chrono::steady_clock::now();
+    if (!force && now - last_status_time < settings.status_interval)
+        return;
+
+    applied_state.save(flushed_lsn);
+    wal_stream->send_status(std::max(received_lsn, flushed_lsn), flushed_lsn, flushed_lsn);
+    last_status_time = now;
+}
+
+void logical_replication_consumer::drain_applier()
+{
+    // The apply batch holds committed transactions only
+    if (open_change_count != 0)
+        current_logger->log_to_file(log_level::DEBUG, fmt::format(
+                       "Dropping {} changes of an unfinished transaction", open_change_count));
+    open_change_count = 0;
+    flush_apply_batch();
+
+    if (!applier)
+        return;
+
+    applier->discard_open_transaction();
+    applier->wait_idle();
+    sync_applied_lsn();
+}
+
+void logical_replication_consumer::open_stream()
+{
+    if (!wal_stream)
+        wal_stream = std::make_unique<postgres::replication_stream>(connection_dsn, current_logger);
+
+    if (wal_stream->is_started())
+        return;
+
+    std::string options;
+    for (const auto & [name, value] : plugin_options())
+        options += fmt::format("{}{} '{}'", options.empty() ? "" : ", ", name, value);
+
+    wal_stream->start(replication_slot_name, get_lsn(result_lsn), options);
+    last_status_time = std::chrono::steady_clock::now();
+}
+
+void logical_replication_consumer::reset_stream()
+{
+    if (wal_stream)
+        wal_stream->close();
+
+    drain_applier();
+
+    // Held changes of the unfinished transaction are received again with the rest of it
+    if (held_changes)
+        held_changes->discard_uncommitted();
+
+    parser->set_stream_replay(false);
+    if (spool && spool->open_transactions() != 0)
+    {
+        spool.reset();
+        spool = std::make_unique<transaction_spool>(settings.spool_directory, replication_slot_name, current_logger);
+    }
+}
+
+void logical_replication_consumer::start_pipeline()
+{
+    open_stream();
+
+    pipeline_stop = false;
+    applied_lsn = get_lsn(result_lsn);
+    stream_lag_bytes = 0;
+    fetch_queue = std::make_unique<bounded_queue<raw_message>>(settings.pipeline_queue_size);
+    apply_queue = std::make_unique<bounded_queue<decoded_change>>(settings.pipeline_queue_size);
+
+    fetch_thread = std::thread(&logical_replication_consumer::fetch_loop, this);
+    decode_thread = std::thread(&logical_replication_consumer::decode_loop, this);
+    current_logger->log_to_file(log_level::INFO, fmt::format("Replication pipeline started from {}", result_lsn));
+}
+
+void logical_replication_consumer::stop_pipeline()
+{
+    if (!fetch_thread.joinable() && !decode_thread.joinable())
+        return;
+
+    pipeline_stop = true;
+    fetch_queue->close();
+    apply_queue->close();
+
+    if (fetch_thread.joinable())
+        fetch_thread.join();
+    if (decode_thread.joinable())
+        decode_thread.join();
+
+    // Decoded but not applied changes are resent from the confirmed lsn
+    reset_stream();
+    relations.clear();
+    decoded_commit = false;
+}
+
+void logical_replication_consumer::fetch_loop()
+{
+    try
+    {
+        uint64_t received_lsn = applied_lsn;
+        uint64_t reported_lsn = received_lsn;
+
+        while (!pipeline_stop)
+        {
+            postgres::replication_message message;
+            postgres::stream_status status = wal_stream->read(message, settings.wait_timeout);
+
+            if (status == postgres::stream_status::END)
+                break;
+
+            if (message.wal_end > applied_lsn)
+                stream_lag_bytes = message.wal_end - applied_lsn;
+
+            if (status == postgres::stream_status::DATA)
+            {
+                received_lsn = message.wal_start;
+                raw_message raw{std::string(message.data, message.size), message.wal_start};
+
+                // Backpressure: keep the walsender informed while the decode stage is behind
+                while (!fetch_queue->push_for(raw, settings.wait_timeout) && !pipeline_stop)
+                    send_status(received_lsn, applied_lsn, false);
+            }
+
+            uint64_t flushed_lsn = applied_lsn;
+            bool reply_requested = status == postgres::stream_status::KEEPALIVE && message.reply_requested;
+            send_status(received_lsn, flushed_lsn, reply_requested || flushed_lsn != reported_lsn);
+            reported_lsn = flushed_lsn;
+        }
+    }
+    catch (const std::exception & e)
+    {
+        current_logger->log_to_file(log_level::ERROR, fmt::format("Exception thrown in fetch stage: {}", e.what()));
+    }
+
+    fetch_queue->close();
+}
+
+void logical_replication_consumer::decode_loop()
+{
+    change_sink enqueue = [this](decoded_change && change) { apply_queue->push(std::move(change)); };
+
+    try
+    {
+        while (auto raw = fetch_queue->pop())
+        {
+            if (pipeline_stop)
+                break;
+
+            decoded_lsn = lsn_to_string(raw->wal_start);
+            process_message(raw->data.data(), raw->data.size(), enqueue);
+        }
+    }
+    catch (const std::exception & e)
+    {
+        current_logger->log_to_file(log_level::ERROR, fmt::format("Exception thrown in decode stage: {}", e.what()));
+    }
+
+    apply_queue->close();
+}
+
+bool logical_replication_consumer::consume_pipelined()
+{
+    if (!fetch_thread.joinable())
+    {
+        try
+        {
+            start_pipeline();
+        }
+        catch (const std::exception & e)
+        {
+            current_logger->log_to_file(log_level::ERROR, fmt::format("Cannot start replication pipeline: {}", e.what()));
+            reset_stream();
+            return false;
+        }
+    }
+
+    bool has_data = false;
+    size_t processed = 0;
+    while (processed < max_block_size)
+    {
+        // The fetch stage keeps answering keepalives while the queues are full
+        if (!can_read_changes())
+            break;
+
+        std::optional<decoded_change> change = apply_queue->pop_for(settings.wait_timeout);
+        if (!change)
+            break;
+
+        has_data = true;
+        ++processed;
+
+        auto apply_started = std::chrono::steady_clock::now();
+        dispatch_change(std::move(*change));
+        batch_apply_time += std::chrono::steady_clock::now() - apply_started;
+        ++batch_fetched;
+    }
+
+    flush_apply_batch();
+    if (!applier)
+        applied_lsn = get_lsn(result_lsn);
+    else
+    {
+        sync_applied_lsn();
+        applied_lsn = applier->get_applied_lsn();
+        metrics::instance().set_gauge(replication_slot_name + ".apply_in_flight", static_cast<int64_t>(applier->in_flight()));
+    }
+
+    slot_lag_bytes = stream_lag_bytes;
+
+    auto & registry = metrics::instance();
+    registry.set_gauge(replication_slot_name + ".fetch_queue_size", static_cast<int64_t>(fetch_queue->size()));
+    registry.set_gauge(replication_slot_name + ".apply_queue_size", static_cast<int64_t>(apply_queue->size()));
+
+    if (apply_queue->is_closed())
+    {
+        current_logger->log_to_file(log_level::WARNING, "Replication pipeline stopped, restarting from the last applied commit");
+        stop_pipeline();
+    }
+
+    return has_data;
+}
+
+bool logical_replication_consumer::consume_streaming()
+{
+    bool has_data = false;
+    try
+    {
+        open_stream();
+
+        size_t processed = 0;
+        while (processed < max_block_size)
+        {
+            // The status sent below keeps the walsender from timing out while reading is paused
+            if (!can_read_changes())
+                break;
+
+            postgres::replication_message message;
+            postgres::stream_status status = wal_stream->read(message, settings.wait_timeout);
+
+            if (status == postgres::stream_status::TIMEOUT || status == postgres::stream_status::END)
+                break;
+
+            if (message.wal_end > lsn_value)
+                slot_lag_bytes = message.wal_end - lsn_value;
+
+            if (status == postgres::stream_status::KEEPALIVE)
+            {
+                if (message.reply_requested)
+                {
+                    sync_applied_lsn();
+                    send_status(lsn_value, get_lsn(result_lsn), true);
+                }
+                continue;
+            }
+
+            has_data = true;
+            ++processed;
+            lsn_value = message.wal_start;
+            decoded_lsn = lsn_to_string(lsn_value);
+
+            auto apply_started = std::chrono::steady_clock::now();
+            process_message(message.data, message.size, apply_sink);
+            batch_apply_time += std::chrono::steady_clock::now() - apply_started;
+            ++batch_fetched;
+        }
+
+        flush_apply_batch();
+        sync_applied_lsn();
+        send_status(lsn_value, get_lsn(result_lsn), is_committed);
+        is_committed = false;
+    }
+    catch (const exception &e)
+    {
+        current_logger->log_to_file(log_level::ERROR, fmt::format("Exception thrown in streaming consume: {}", e.what()));
+        reset_stream();
+        return false;
+    }
+    catch (const std::exception & e)
+    {
+        current_logger->log_to_file(log_level::ERROR, e.what());
+        reset_stream();
+        return false;
+    }
+
+    return has_data;
+}
+
+bool logical_replication_consumer::consume_polling()
+{
+    if (!can_read_changes())
+        return false;
+
+    // Peek starts from the slot position again: transactions of a failed batch must not be applied twice,
+    // and chunks of a streamed transaction still open are sent again, the spool starts empty for them
+    reset_stream();
     update_lsn();
     bool is_slot_empty = true;
     try
     {
         auto tx = std::make_shared<pqxx::nontransaction>(connection->get_ref());
 
+        std::string options;
+        for (const auto & [name, value] : plugin_options())
+            options += fmt::format(", '{}', '{}'", name, value);
+
         std::string query_str = fmt::format(
-                "select lsn, data FROM pg_logical_slot_peek_binary_changes("
-                "'{}', NULL, {}, 'publication_names', '{}', 'proto_version', '1')",
-                replication_slot_name, max_block_size, publication_name);
+                "select lsn, data FROM pg_logical_slot_peek_binary_changes('{}', NULL, {}{})",
+                replication_slot_name, max_block_size, options);
 
         pqxx::stream_from stream{pqxx::stream_from::query(*tx, query_str)};
 
-        logical_replication_parser parser = logical_replication_parser(&current_lsn, &result_lsn, &is_committed, current_logger);
-
         while (true)
         {
             const std::vector<pqxx::zview> * row{stream.read_row()};
@@ -113,35 +935,21 @@ bool logical_replication_consumer::consume()
             }
 
             is_slot_empty = false;
-            current_lsn = (*row)[0];
-            lsn_value = get_lsn(current_lsn);
+            decoded_lsn = (*row)[0];
+            lsn_value = get_lsn(decoded_lsn);
 
             std::cout << fmt::format("Current message: {}", (*row)[1]) << std::endl;
 
-            try
-            {
-                std::vector<std::string> result;
-                std::unordered_map<int32_t, std::string> old_value;
-                postgre_sql_type_operation type_operation;
-                int32_t table_id_query;
-                parser.parse_binary_data((*row)[1].c_str(),
-                                       (*row)[1].size(),
-                                       type_operation,
-                                       table_id_query,
-                                       result,
-                                       id_to_table_name,
-                                       id_skip_table_name,
-                                       id_table_to_column,
-                                       old_value);
-                current_otterbrix_service.data_handler(type_operation, id_to_table_name[table_id_query], database_name,
-                                                       get_primary_key(table_id_query), result,
-                                                       id_table_to_column[table_id_query], old_value);
-            }
-            catch (const exception &e)
-            {
-                current_logger->log_to_file(log_level::ERROR, fmt::format("Error during parsing: {}", e.what()));
-            }
+            hex::decode_bytea((*row)[1].c_str(), (*row)[1].size(), message_buffer);
+            auto apply_started = std::chrono::steady_clock::now();
+            process_message(message_buffer.data(), message_buffer.size(), apply_sink);
+            batch_apply_time += std::chrono::steady_clock::now() - apply_started;
+            ++batch_fetched;
         }
+
+        auto drain_started = std::chrono::steady_clock::now();
+        drain_applier();
+        batch_apply_time += std::chrono::steady_clock::now() - drain_started;
     }
     catch (const exception &e)
     {
@@ -1,9 +1,14 @@
 #include <boost/mpl/placeholders.hpp>
 #include <fmt/format.h>
+#include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <mutex>
+#include <unordered_map>
 
 #include <logical_replication/logical_replication_handler.h>
 #include <postgres/сonnection.h>
+#include <postgres/postgres_settings.h>
 #include <common/exception.h>
 
 namespace {
@@ -81,45 +86,108 @@ logical_replication_handler::logical_replication_handler(
     std::vector<std::string> &tables_array_,
     size_t max_block_size_,
     const bool user_managed_slot_,
-    const std::string user_snapshot_)
+    const std::string user_snapshot_,
+    const replication_settings & settings_)
     : connection_dsn(connection_dsn_),
       current_logger(file_name_, url_log_),
       tables_array(tables_array_),
       database_name(postgres_database_),
-      tables_names(create_tables_names(tables_array_)),
-      replication_slot(get_replication_slot_name(postgres_database_, postgres_name_)),
-      publication_name(get_publication_name(postgres_database_, postgres_name_)),
       user_managed_slot(user_managed_slot_),
       user_snapshot(user_snapshot_),
-      max_block_size(max_block_size_)
+      max_block_size(max_block_size_),
+      settings(settings_),
+      snapshot_budget(settings_.snapshot_memory_budget_bytes)
 {
-    if (tables_names.empty()) {
+    if (tables_array.empty()) {
         throw exception(error_codes::BAD_ARGUMENTS, "Can not have tables list");
     }
 
-    check_replication_slot(replication_slot);
+    size_t shard_count = std::min(std::max<size_t>(settings.shard_count, 1), tables_array.size());
+    if (shard_count > 1 && user_managed_slot) {
+        throw exception(error_codes::BAD_ARGUMENTS, "User managed slot can not be used with several shards");
+    }
 
-    current_logger.log_to_file(log_level::DEBUG, fmt::format(
-               "Using replication slot {} and publication {}",
-               replication_slot,
-               double_quote_string(publication_name)));
+    const std::string replication_slot = get_replication_slot_name(postgres_database_, postgres_name_);
+    const std::string publication_name = get_publication_name(postgres_database_, postgres_name_);
+
+    shards.resize(shard_count);
+    for (size_t i = 0; i < tables_array.size(); ++i) {
+        shards[i % shard_count].tables.push_back(tables_array[i]);
+    }
+
+    for (size_t i = 0; i < shard_count; ++i) {
+        replication_shard & shard = shards[i];
+        shard.tables_names = create_tables_names(shard.tables);
+        shard.replication_slot = shard_count == 1 ? replication_slot : fmt::format("{}_shard_{}", replication_slot, i);
+        shard.publication_name = shard_count == 1 ? publication_name : fmt::format("{}_shard_{}", publication_name, i);
+
+        check_replication_slot(shard.replication_slot);
+
+        current_logger.log_to_file(log_level::DEBUG, fmt::format(
+                   "Using replication slot {} and publication {} for tables: {}",
+                   shard.replication_slot,
+                   double_quote_string(shard.publication_name),
+                   shard.tables_names));
+    }
 }
 
 bool logical_replication_handler::run_consumer() {
-    return get_consumer()->consume();
+    if (shards.size() == 1) {
+        return get_consumer()->consume();
+    }
+
+    std::vector<std::future<bool>> results;
+    results.reserve(shards.size());
+    for (size_t i = 0; i < shards.size(); ++i) {
+        results.push_back(std::async(std::launch::async, [consumer = get_consumer(i)] { return consumer->consume(); }));
+    }
+
+    bool has_data = false;
+    for (auto & result : results) {
+        has_data |= result.get();
+    }
+    return has_data;
 }
 
 void logical_replication_handler::start_synchronization() {
-    postgres::сonnection replication_connection(connection_dsn, &current_logger, true);
-    pqxx::nontransaction tx(replication_connection.get_ref());
-    create_publication(tx);
+    if (shards.size() == 1) {
+        synchronize_shard(shards.front());
+        return;
+    }
+
+    // Every shard has its own slot and snapshot, the initial loads run side by side
+    std::vector<std::future<void>> results;
+    results.reserve(shards.size());
+    for (auto & shard : shards) {
+        results.push_back(std::async(std::launch::async, [this, &shard] { synchronize_shard(shard); }));
+    }
+
+    for (auto & result : results) {
+        result.get();
+    }
+}
+
+void logical_replication_handler::synchronize_shard(replication_shard & shard) {
+    // Kept open while the tables are read: the exported snapshot lives as long as the connection that made the slot
+    auto replication_connection = std::make_unique<postgres::сonnection>(connection_dsn, &current_logger, true);
+    auto tx = std::make_unique<pqxx::nontransaction>(replication_connection->get_ref());
+    create_publication(*tx, shard);
 
     std::string snapshot_name;
     std::string start_lsn;
     auto tmp_connection = std::make_shared<postgres::сonnection>(connection_dsn, &current_logger);
+    auto checkpoint = std::make_shared<snapshot_checkpoint>(
+        settings.state_directory / fmt::format("{}.snapshot", shard.replication_slot), &current_logger);
+    applied_lsn_file applied_state(settings.state_directory, shard.replication_slot, &current_logger);
+    bool load_pending = false;
+
+    const bool concurrent = settings.concurrent_snapshot && settings.mode == replication_mode::STREAMING;
+    if (settings.concurrent_snapshot && !concurrent)
+        current_logger.log_to_file(log_level::WARNING, "Concurrent snapshot requires streaming mode, tables are loaded first");
 
     auto initial_sync = [&]() {
-        current_logger.log_to_file(log_level::DEBUG, "Starting tables sync load");
+        current_logger.log_to_file(log_level::DEBUG, fmt::format("Starting tables sync load for slot {}",
+                                                                 shard.replication_slot));
 
         try
         {
@@ -132,12 +200,13 @@ void logical_replication_handler::start_synchronization() {
             }
             else
             {
-                create_replication_slot(tx, start_lsn, snapshot_name);
+                create_replication_slot(*tx, shard, start_lsn, snapshot_name);
             }
 
-            for (std::string table_name : tables_array) {
-                load_from_snapshot(*tmp_connection, snapshot_name, table_name);
-            }
+            applied_state.remove();
+            checkpoint->start(shard.replication_slot, snapshot_name, start_lsn,
+                              plan_snapshot(*tmp_connection, shard.tables), concurrent);
+            load_pending = true;
         }
         catch (exception &e)
         {
@@ -145,77 +214,248 @@ void logical_replication_handler::start_synchronization() {
         }
     };
 
-    if (!has_replication_slot(tx, start_lsn)) {
+    // The tables were loaded and changes applied before: keep the slot and catch up from where apply stopped
+    auto resume_consumption = [&]() {
+        if (!checkpoint->load() || !checkpoint->is_complete() || checkpoint->get_slot_name() != shard.replication_slot)
+            return false;
+
+        std::optional<uint64_t> applied_lsn = applied_state.load();
+        if (!applied_lsn || *applied_lsn < string_to_lsn(start_lsn))
+        {
+            current_logger.log_to_file(log_level::WARNING, fmt::format(
+                           "Applied lsn of slot {} is behind its confirmed lsn {}, loading again",
+                           shard.replication_slot, start_lsn));
+            return false;
+        }
+
+        // Changes confirmed locally but not on the server yet are skipped as well
+        start_lsn = lsn_to_string(*applied_lsn);
+        current_logger.log_to_file(log_level::INFO, fmt::format(
+                       "Resuming slot {} from applied lsn {}", shard.replication_slot, start_lsn));
+        return true;
+    };
+
+    // Opened when a resumed load reads under a snapshot of its own, kept open while the tables are read
+    std::unique_ptr<postgres::сonnection> snapshot_connection;
+    std::unique_ptr<pqxx::replication_transaction> snapshot_tx;
+
+    // The previous load stopped halfway: keep the slot and continue every task after its last written chunk.
+    // The exported snapshot dies with the process that made the slot, the rest is then read under a new one
+    auto resume_sync = [&]() {
+        if (!checkpoint->load() || checkpoint->is_complete() || checkpoint->get_slot_name() != shard.replication_slot)
+            return false;
+
+        const std::string saved_snapshot = checkpoint->get_snapshot_name();
+        if (user_managed_slot && saved_snapshot != user_snapshot)
+        {
+            current_logger.log_to_file(log_level::WARNING, fmt::format(
+                           "Snapshot {} of the interrupted load for slot {} is not the given one, loading again",
+                           saved_snapshot, shard.replication_slot));
+            return false;
+        }
+
+        // A newer snapshot sees rows moved into a range that is not done yet and misses rows moved into one
+        // that is, and the changes applied during a concurrent load are received again. The rows are written
+        // by primary key, replayed inserts and updates as upserts; replayed deletes are idempotent as they are
+        const bool same_snapshot = is_snapshot_available(*tmp_connection, saved_snapshot);
+        const bool reconcile = !same_snapshot || checkpoint->is_streamed();
+        if (reconcile && !has_primary_keys(shard.tables))
+        {
+            current_logger.log_to_file(log_level::WARNING, fmt::format(
+                           "Interrupted load for slot {} can not be continued, not every table has a primary key, loading again",
+                           shard.replication_slot));
+            return false;
+        }
+
+        uint64_t reconcile_lsn = 0;
+        try
+        {
+            if (same_snapshot)
+            {
+                snapshot_name = saved_snapshot;
+            }
+            else
+            {
+                snapshot_connection = std::make_unique<postgres::сonnection>(connection_dsn, &current_logger);
+                snapshot_tx = std::make_unique<pqxx::replication_transaction>(snapshot_connection->get_ref());
+                pqxx::result result{snapshot_tx->exec("SELECT pg_export_snapshot()")};
+                snapshot_name = result[0][0].as<std::string>();
+            }
+
+            // Every transaction the snapshot sees has committed before the current WAL position
+            if (reconcile)
+            {
+                pqxx::nontransaction lsn_tx(tmp_connection->get_ref());
+                pqxx::result result{lsn_tx.exec("SELECT pg_current_wal_lsn()")};
+                reconcile_lsn = string_to_lsn(result[0][0].as<std::string>());
+            }
+        }
+        catch (const std::exception &e)
+        {
+            current_logger.log_to_file(log_level::WARNING, fmt::format(
+                           "Cannot take a snapshot to continue the load for slot {}: {}, loading again",
+                           shard.replication_slot, e.what()));
+            snapshot_tx.reset();
+            snapshot_connection.reset();
+            return false;
+        }
+
+        current_logger.log_to_file(log_level::INFO, fmt::format(
+                       "Resuming the initial load for slot {} from snapshot {}{}", shard.replication_slot, snapshot_name,
+                       same_snapshot ? "" : fmt::format(", the interrupted snapshot {} is gone", saved_snapshot)));
+        checkpoint->resume(snapshot_name, !same_snapshot, reconcile_lsn);
+        start_lsn = checkpoint->get_start_lsn();
+        load_pending = true;
+        return true;
+    };
+
+    if (!has_replication_slot(*tx, shard, start_lsn)) {
         initial_sync();
-    } else {
+    } else if (!resume_consumption() && !resume_sync()) {
         if (!user_managed_slot) {
-            drop_replication_slot(tx);
+            drop_replication_slot(*tx, shard);
         }
         initial_sync();
     }
 
-    tx.commit();
+    if (load_pending && !concurrent) {
+        try
+        {
+            load_tables(*tmp_connection, *checkpoint, snapshot_name);
+            checkpoint->finish();
+
+            // The loaded tables are as of the slot's consistent point
+            applied_state.save(string_to_lsn(start_lsn));
+        }
+        catch (exception &e)
+        {
+            current_logger.log_to_file(log_level::ERROR, e.what());
+        }
+    }
+
+    // pgoutput names relations schema.table, the tables may be given without a schema
+    std::unordered_map<std::string, std::string> relation_names;
+    std::vector<std::string> loading_tables;
+    if (load_pending && concurrent) {
+        pqxx::nontransaction names_tx(tmp_connection->get_ref());
+        for (const auto & task : checkpoint->get_tasks()) {
+            if (task.done || relation_names.contains(task.table_name))
+                continue;
+
+            relation_names[task.table_name] = get_relation_name(names_tx, task.table_name);
+            loading_tables.push_back(relation_names[task.table_name]);
+        }
+    }
+
+    if (!concurrent || !load_pending) {
+        tx->commit();
+    }
 
-    consumer = std::make_shared<logical_replication_consumer>(
+    shard.consumer = std::make_shared<logical_replication_consumer>(
         connection_dsn,
         std::move(tmp_connection),
         database_name,
-        replication_slot,
-        publication_name,
+        shard.replication_slot,
+        shard.publication_name,
         start_lsn,
         max_block_size,
-        &current_logger);
-    current_logger.log_to_file(log_level::DEBUG, "Consumer created");
+        &current_logger,
+        settings);
+    current_logger.log_to_file(log_level::DEBUG, fmt::format("Consumer created for slot {}", shard.replication_slot));
+
+    // Until the stream passes the resumed load, its inserts and updates are written by primary key
+    if (checkpoint->get_reconcile_lsn() != 0)
+        shard.consumer->reconcile_until(checkpoint->get_reconcile_lsn());
+
+    if (!concurrent || !load_pending)
+        return;
+
+    // Changes of a table are applied by the consumer once its load is done, until then they are held.
+    // The load is complete once the held changes are applied too: before that, changes of the tables
+    // loaded first are applied but not confirmed, a restart continues the load and reconciles them
+    shard.consumer->hold_tables(loading_tables, [this, &shard, checkpoint] {
+        checkpoint->finish();
+        current_logger.log_to_file(log_level::INFO, fmt::format(
+                       "Initial load for slot {} is applied", shard.replication_slot));
+    });
+    shard.snapshot_load = std::async(std::launch::async,
+        [this, &shard, replication_connection = std::move(replication_connection), tx = std::move(tx),
+         snapshot_connection = std::move(snapshot_connection), snapshot_tx = std::move(snapshot_tx),
+         checkpoint, relation_names = std::move(relation_names), snapshot_name]() mutable
+    {
+        try
+        {
+            postgres::сonnection load_connection(connection_dsn, &current_logger);
+            load_tables(load_connection, *checkpoint, snapshot_name, [&](const std::string & table_name) {
+                shard.consumer->finish_table_load(relation_names.at(table_name));
+            });
+            current_logger.log_to_file(log_level::INFO, fmt::format(
+                           "Initial load for slot {} is done, its held changes are applied next", shard.replication_slot));
+        }
+        catch (const std::exception &e)
+        {
+            current_logger.log_to_file(log_level::ERROR, fmt::format(
+                           "Initial load for slot {} failed: {}", shard.replication_slot, e.what()));
+            shard.consumer->abandon_table_loads();
+        }
+
+        snapshot_tx.reset();
+        snapshot_connection.reset();
+        tx.reset();
+        replication_connection.reset();
+    });
 }
 
-logical_replication_handler::consumer_ptr logical_replication_handler::get_consumer()
+logical_replication_handler::consumer_ptr logical_replication_handler::get_consumer(size_t shard)
 {
-    if (!consumer)
+    if (shard >= shards.size() || !shards[shard].consumer)
         throw exception(error_codes::LOGICAL_ERROR, "Consumer not initialized");
 
-    return consumer;
+    return shards[shard].consumer;
 }
 
-bool logical_replication_handler::has_publication(pqxx::nontransaction & tx)
+bool logical_replication_handler::has_publication(pqxx::nontransaction & tx, const replication_shard & shard)
 {
     std::string query_str = fmt::format("SELECT exists (SELECT 1 FROM pg_publication WHERE pubname = '{}')",
-                                        publication_name);
+                                        shard.publication_name);
     pqxx::result result{tx.exec(query_str)};
 
     if (result.empty())
         throw exception(error_codes::LOGICAL_ERROR,
-            fmt::format("Publication does not exist: {}", publication_name));
+            fmt::format("Publication does not exist: {}", shard.publication_name));
 
     return result[0][0].as<std::string>() == "t";
 }
 
-void logical_replication_handler::create_publication(pqxx::nontransaction &tx) {
-    auto publication_exists = has_publication(tx);
+void logical_replication_handler::create_publication(pqxx::nontransaction &tx, const replication_shard & shard) {
+    auto publication_exists = has_publication(tx, shard);
 
     if (!publication_exists) {
-        if (tables_names.empty())
+        if (shard.tables_names.empty())
             throw std::logic_error("No table found to be replicated");
 
         std::string query_str = fmt::format("CREATE PUBLICATION {} FOR TABLE ONLY {}",
-                                            publication_name, tables_names);
+                                            shard.publication_name, shard.tables_names);
         try
         {
             tx.exec(query_str);
             current_logger.log_to_file(log_level::DEBUG, fmt::format(
-                       "Created publication {} with tables: {}", publication_name, tables_names));
+                       "Created publication {} with tables: {}", shard.publication_name, shard.tables_names));
         }
         catch (const std::exception& e)
         {
             throw exception(error_codes::LOGICAL_ERROR, fmt::format("While creating publication {}", e.what()));
         }
     } else {
-        current_logger.log_to_file(log_level::DEBUG, fmt::format("Using publication {}", publication_name));
+        current_logger.log_to_file(log_level::DEBUG, fmt::format("Using publication {}", shard.publication_name));
     }
 }
 
-bool logical_replication_handler::has_replication_slot(pqxx::nontransaction & tx, std::string & start_lsn)
+bool logical_replication_handler::has_replication_slot(pqxx::nontransaction & tx,
+                                                       const replication_shard & shard,
+                                                       std::string & start_lsn)
 {
-    std::string slot_name = replication_slot;
+    std::string slot_name = shard.replication_slot;
 
     std::string query_str = fmt::format(
         "SELECT active, restart_lsn, confirmed_flush_lsn FROM pg_replication_slots WHERE slot_name = '{}'",
@@ -234,10 +474,11 @@ bool logical_replication_handler::has_replication_slot(pqxx::nontransaction & tx
 }
 
 void logical_replication_handler::create_replication_slot(pqxx::nontransaction &tx,
+                                                      const replication_shard & shard,
                                                       std::string &start_lsn,
                                                       std::string &snapshot_name) {
     std::string query_str;
-    std::string slot_name = replication_slot;
+    std::string slot_name = shard.replication_slot;
 
     query_str = fmt::format("CREATE_REPLICATION_SLOT {} LOGICAL pgoutput EXPORT_SNAPSHOT",
                             double_quote_string(slot_name));
@@ -249,7 +490,7 @@ void logical_replication_handler::create_replication_slot(pqxx::nontransaction &
         snapshot_name = result[0][2].as<std::string>();
         current_logger.log_to_file(log_level::INFO, fmt::format(
                        "Created replication slot: {}, start lsn: {}, snapshot: {}",
-                       replication_slot, start_lsn, snapshot_name));
+                       slot_name, start_lsn, snapshot_name));
     }
     catch (std::exception &e)
     {
@@ -258,9 +499,9 @@ void logical_replication_handler::create_replication_slot(pqxx::nontransaction &
     }
 }
 
-void logical_replication_handler::drop_replication_slot(pqxx::nontransaction & tx)
+void logical_replication_handler::drop_replication_slot(pqxx::nontransaction & tx, const replication_shard & shard)
 {
-    std::string slot_name = replication_slot;
+    std::string slot_name = shard.replication_slot;
 
     std::string query_str = fmt::format("SELECT pg_drop_replication_slot('{}')", slot_name);
 
@@ -268,20 +509,295 @@ void logical_replication_handler::drop_replication_slot(pqxx::nontransaction & t
     current_logger.log_to_file(log_level::INFO, fmt::format("Dropped replication slot: {}", slot_name));
 }
 
+bool logical_replication_handler::has_primary_keys(const std::vector<std::string> & tables)
+{
+    postgres_settings table_settings(connection_dsn, &current_logger);
+    for (std::string table_name : tables)
+    {
+        if (table_settings.get_primary_key(table_name).empty())
+            return false;
+    }
+    return true;
+}
+
+std::string logical_replication_handler::get_relation_name(pqxx::transaction_base & tx, const std::string & table_name)
+{
+    std::string query_str = fmt::format(
+        "SELECT n.nspname || '.' || c.relname FROM pg_class c JOIN pg_namespace n ON n.oid = c.relnamespace "
+        "WHERE c.oid = {}::regclass",
+        tx.quote(table_name));
+    pqxx::result result{tx.exec(query_str)};
+
+    if (result.empty())
+        throw exception(error_codes::LOGICAL_ERROR, fmt::format("Table {} does not exist", table_name));
+
+    return result[0][0].as<std::string>();
+}
+
+std::vector<std::pair<std::string, int32_t>> logical_replication_handler::get_table_columns(pqxx::transaction_base & tx,
+                                                                                            const std::string & table_name,
+                                                                                            std::vector<int32_t> & type_modifiers)
+{
+    std::string query_str = fmt::format(
+        "SELECT attname, atttypid, atttypmod FROM pg_attribute "
+        "WHERE attrelid = {}::regclass AND attnum > 0 AND NOT attisdropped ORDER BY attnum",
+        tx.quote(table_name));
+    pqxx::result result{tx.exec(query_str)};
+
+    if (result.empty())
+        throw exception(error_codes::LOGICAL_ERROR, fmt::format("Table {} has no columns", table_name));
+
+    std::vector<std::pair<std::string, int32_t>> columns;
+    columns.reserve(result.size());
+    type_modifiers.clear();
+    type_modifiers.reserve(result.size());
+    for (const auto & row : result) {
+        columns.emplace_back(row[0].as<std::string>(), row[1].as<int32_t>());
+        type_modifiers.push_back(row[2].as<int32_t>());
+    }
+    return columns;
+}
+
+std::vector<snapshot_task> logical_replication_handler::plan_snapshot(
+    postgres::сonnection & connection,
+    const std::vector<std::string> & tables)
+{
+    pqxx::nontransaction tx(connection.get_ref());
+    const size_t chunk_rows = std::max<size_t>(settings.snapshot_chunk_rows, 1);
+
+    pqxx::result block_size_result{tx.exec("SELECT current_setting('block_size')::bigint")};
+    const uint64_t block_size = block_size_result[0][0].as<uint64_t>();
+
+    std::vector<snapshot_task> tasks;
+    tasks.reserve(tables.size());
+    for (const std::string & table_name : tables)
+    {
+        std::string query_str = fmt::format(
+            "SELECT pg_relation_size(oid), greatest(reltuples, 0)::bigint FROM pg_class WHERE oid = {}::regclass",
+            tx.quote(table_name));
+        pqxx::result result{tx.exec(query_str)};
+
+        snapshot_task task;
+        task.table_name = table_name;
+        if (!result.empty())
+        {
+            task.size_bytes = result[0][0].as<uint64_t>();
+            auto estimated_rows = result[0][1].as<uint64_t>();
+
+            // One chunk of rows is in memory at a time, counted at the on-disk row width
+            task.memory_bytes = estimated_rows == 0
+                ? task.size_bytes
+                : std::min<uint64_t>(task.size_bytes, task.size_bytes / estimated_rows * chunk_rows);
+        }
+
+        const uint64_t blocks = task.size_bytes / block_size;
+        const uint64_t range_blocks = std::max<uint64_t>(settings.snapshot_split_bytes / block_size, 1);
+        if (settings.snapshot_split_bytes == 0 || blocks <= range_blocks)
+        {
+            tasks.push_back(std::move(task));
+            continue;
+        }
+
+        // ctid block ranges; the last one is open, so pages added after the size was taken are read too
+        const uint64_t range_count = (blocks + range_blocks - 1) / range_blocks;
+        current_logger.log_to_file(log_level::INFO, fmt::format(
+                       "Splitting table {} into {} ranges of {} blocks", table_name, range_count, range_blocks));
+        for (uint64_t range = 0; range < range_count; ++range)
+        {
+            snapshot_task range_task = task;
+            range_task.size_bytes = std::min(range_blocks * block_size, task.size_bytes - range * range_blocks * block_size);
+            range_task.memory_bytes = std::min(task.memory_bytes, range_task.size_bytes);
+            range_task.condition = range + 1 == range_count
+                ? fmt::format("ctid >= '({},0)'::tid", range * range_blocks)
+                : fmt::format("ctid >= '({},0)'::tid AND ctid < '({},0)'::tid", range * range_blocks, (range + 1) * range_blocks);
+            tasks.push_back(std::move(range_task));
+        }
+    }
+
+    // Largest first, so the longest load does not start last
+    std::stable_sort(tasks.begin(), tasks.end(), [](const snapshot_task & left, const snapshot_task & right) {
+        return left.size_bytes > right.size_bytes;
+    });
+    return tasks;
+}
+
+bool logical_replication_handler::is_snapshot_available(postgres::сonnection & connection, const std::string & snapshot_name)
+{
+    try
+    {
+        pqxx::replication_transaction tx(connection.get_ref());
+        tx.exec(fmt::format("SET TRANSACTION SNAPSHOT '{}'", snapshot_name));
+        return true;
+    }
+    catch (const pqxx::sql_error &)
+    {
+        return false;
+    }
+}
+
+void logical_replication_handler::load_tables(postgres::сonnection & connection,
+                                              snapshot_checkpoint & checkpoint,
+                                              std::string & snapshot_name,
+                                              const std::function<void(const std::string &)> & table_loaded)
+{
+    std::vector<size_t> pending_tasks;
+    std::unordered_map<std::string, size_t> remaining_tasks;
+    const std::vector<snapshot_task> tasks = checkpoint.get_tasks();
+    for (size_t i = 0; i < tasks.size(); ++i)
+    {
+        if (!tasks[i].done)
+        {
+            pending_tasks.push_back(i);
+            ++remaining_tasks[tasks[i].table_name];
+        }
+    }
+    const size_t workers = std::min(std::max<size_t>(settings.snapshot_workers, 1), pending_tasks.size());
+
+    std::atomic<size_t> next_task{0};
+    std::mutex remaining_mutex;
+    auto run_tasks = [&](postgres::сonnection & worker_connection)
+    {
+        otterbrix_service service;
+        for (size_t i = next_task++; i < pending_tasks.size(); i = next_task++)
+        {
+            const snapshot_task & task = tasks[pending_tasks[i]];
+            snapshot_budget.acquire(task.memory_bytes);
+            try
+            {
+                load_from_snapshot(worker_connection, service, snapshot_name, task, pending_tasks[i], checkpoint);
+            }
+            catch (...)
+            {
+                snapshot_budget.release(task.memory_bytes);
+                throw;
+            }
+            snapshot_budget.release(task.memory_bytes);
+
+            // A split table is loaded once its last range is
+            bool is_table_loaded;
+            {
+                std::lock_guard guard(remaining_mutex);
+                is_table_loaded = --remaining_tasks[task.table_name] == 0;
+            }
+            if (is_table_loaded && table_loaded)
+                table_loaded(task.table_name);
+        }
+    };
+
+    if (workers <= 1)
+    {
+        run_tasks(connection);
+        return;
+    }
+
+    current_logger.log_to_file(log_level::INFO, fmt::format(
+                   "Loading {} tables on {} connections", pending_tasks.size(), workers));
+
+    // Every worker imports the same exported snapshot, so all tables are read at one point in time
+    std::vector<std::future<void>> results;
+    results.reserve(workers);
+    for (size_t i = 0; i < workers; ++i)
+    {
+        results.push_back(std::async(std::launch::async, [this, &run_tasks]
+        {
+            postgres::сonnection worker_connection(connection_dsn, &current_logger);
+            run_tasks(worker_connection);
+        }));
+    }
+
+    for (auto & result : results)
+        result.wait();
+    for (auto & result : results)
+        result.get();
+}
+
 void logical_replication_handler::load_from_snapshot(postgres::сonnection &connection,
+                                                 otterbrix_service &service,
                                                  std::string &snapshot_name,
-                                                 const std::string &table_name) {
-    auto tx = std::make_shared<pqxx::replication_transaction>(connection.get_ref());
+                                                 const snapshot_task &task,
+                                                 size_t task_index,
+                                                 snapshot_checkpoint &checkpoint) {
+    const std::string & table_name = task.table_name;
+    pqxx::replication_transaction tx(connection.get_ref());
 
     std::string query_str = fmt::format("SET TRANSACTION SNAPSHOT '{}'", snapshot_name);
-    tx->exec(query_str);
+    tx.exec(query_str);
+
+    // A resumed task continues after its last written row, the scan has to return the rows in ctid order
+    tx.exec("SET LOCAL synchronize_seqscans = off");
+    tx.exec("SET LOCAL max_parallel_workers_per_gather = 0");
+
+    std::vector<int32_t> type_modifiers;
+    const std::vector<std::pair<std::string, int32_t>> columns = get_table_columns(tx, table_name, type_modifiers);
+    const tsl::row_decoder decoder = tsl::make_row_decoder(columns, type_modifiers);
+    const size_t chunk_rows = std::max<size_t>(settings.snapshot_chunk_rows, 1);
+
+    std::vector<int32_t> primary_key;
+    if (task.replace)
+    {
+        std::string qualified_name = table_name;
+        postgres_settings table_settings(connection_dsn, &current_logger);
+        const std::set<std::string> key_names = table_settings.get_primary_key(qualified_name);
+        for (size_t column = 0; column < columns.size(); ++column)
+        {
+            if (key_names.contains(columns[column].first))
+                primary_key.push_back(static_cast<int32_t>(column));
+        }
+        if (primary_key.empty())
+            throw exception(error_codes::LOGICAL_ERROR, fmt::format(
+                            "Table {} has no primary key to write the rows of a resumed load over", table_name));
+    }
+
+    std::string condition = task.condition;
+    if (!task.resume_after.empty())
+        condition = fmt::format("{}{}ctid > {}::tid", condition, condition.empty() ? "" : " AND ", tx.quote(task.resume_after));
 
-    query_str = fmt::format("SELECT * FROM ONLY {}", table_name);
+    current_logger.log_to_file(log_level::DEBUG, fmt::format("Loading PostgreSQL table {} {}", table_name, condition));
 
-    current_logger.log_to_file(log_level::DEBUG, fmt::format("Loading PostgreSQL table {}", table_name));
+    // COPY streams the rows, only one chunk of documents is held at a time
+    query_str = condition.empty()
+        ? fmt::format("SELECT ctid, * FROM ONLY {}", table_name)
+        : fmt::format("SELECT ctid, * FROM ONLY {} WHERE {}", table_name, condition);
+    pqxx::stream_from stream{pqxx::stream_from::query(tx, query_str)};
 
-    // Getting data from the database to start syncing
-    pqxx::result result = tx->exec(query_str);
+    replication_row row;
+    const replication_row old_value;
+    // Without a bound the task starts over
+    size_t rows = task.resume_after.empty() ? 0 : task.rows_done;
+    size_t chunk_pending = 0;
+    while (const std::vector<pqxx::zview> * fields = stream.read_row())
+    {
+        // The first field is the ctid, a row of another shape would shift every column
+        if (fields->size() != columns.size() + 1)
+            throw exception(error_codes::LOGICAL_ERROR, fmt::format(
+                            "COPY of table {} returned {} fields for {} columns", table_name, fields->size() - 1, columns.size()));
+
+        row.reset(columns.size());
+        for (size_t column = 0; column < columns.size(); ++column)
+        {
+            const pqxx::zview & field = (*fields)[column + 1];
+            if (field.data() != nullptr)
+                row.set(column, 't', field.data(), field.size());
+        }
 
-    current_otterbrix_service.data_handler(result, table_name, database_name);
-}
\ No newline at end of file
+        if (task.replace)
+            service.add_upsert(table_name, database_name, primary_key, row, decoder);
+        else
+            service.add_change(postgre_sql_type_operation::INSERT, table_name, database_name,
+                               {}, row, decoder, old_value);
+        ++rows;
+        if (++chunk_pending >= chunk_rows)
+        {
+            service.flush();
+            checkpoint.chunk_done(task_index, rows, std::string((*fields)[0]));
+            chunk_pending = 0;
+        }
+    }
+
+    stream.complete();
+    service.flush();
+    tx.commit();
+    checkpoint.task_done(task_index, rows);
+
+    current_logger.log_to_file(log_level::INFO, fmt::format("Loaded {} rows of PostgreSQL table {} {}", rows, table_name, task.condition));
+}
@@ -1,9 +1,12 @@
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <vector>
 #include <fmt/format.h>
 
 #include <logical_replication/logical_replication_parser.h>
 #include <common/exception.h>
+#include <postgres/postgres_binary.h>
 
 logical_replication_parser::logical_replication_parser(
     std::string *current_lsn_,
@@ -16,175 +19,97 @@ logical_replication_parser::logical_replication_parser(
       current_logger(logger_) {
 }
 
-uint8_t logical_replication_parser::hex_char_to_digit(char c) {
-    if (c >= '0' && c <= '9') {
-        return static_cast<uint8_t>(c - '0'); //'0'-'9'
-    }
-    if (c >= 'A' && c <= 'F') {
-        return static_cast<uint8_t>(c - 'A' + 10); //'A'-'F'
-    }
-    if (c >= 'a' && c <= 'f') {
-        return static_cast<uint8_t>(c - 'a' + 10); //'a'-'f'
-    }
-    return 0xFF; //0xFF for other
-}
-
-uint8_t logical_replication_parser::hex_2_char_to_digit(const char *data) {
-    return  hex_char_to_digit(data[0]) * 0x10 + hex_char_to_digit(data[1]);
-}
-
-template<typename T>
-T logical_replication_parser::hex_n_char_to_t(const char * message, size_t pos, size_t n)
-{
-    T result = 0;
-    for (size_t i = 0; i < n; ++i)
-    {
-        if (i) result <<= 8;
-        result |= static_cast<uint32_t>(hex_2_char_to_digit(message + pos + 2 * i));
-    }
-    return result;
-}
-
 int8_t logical_replication_parser::parse_int8(const char * message, size_t & pos, size_t size)
 {
-    if (size < pos + 2) {
+    if (size < pos + 1) {
         throw exception(error_codes::LOGICAL_ERROR, "Message small from parse int8");
     }
-    int8_t result = hex_2_char_to_digit(message + pos);
-    pos += 2;
+    int8_t result = static_cast<int8_t>(message[pos]);
+    pos += 1;
     return result;
 }
 
 int16_t logical_replication_parser::parse_int16(const char * message, size_t & pos, size_t size)
 {
-    if (size < pos + 4) {
+    if (size < pos + 2) {
         throw exception(error_codes::LOGICAL_ERROR, "Message small from parse int16");
     }
-    int16_t result = hex_n_char_to_t<int16_t>(message, pos, 2);
-    pos += 4;
+    int16_t result = postgres::binary::read_be<int16_t>(message + pos);
+    pos += 2;
     return result;
 }
 
 int32_t logical_replication_parser::parse_int32(const char * message, size_t & pos, size_t size)
 {
-    if (size < pos + 8) {
+    if (size < pos + 4) {
         throw exception(error_codes::LOGICAL_ERROR, "Message small from parse int32");
     }
-    int32_t result = hex_n_char_to_t<int32_t>(message, pos, 4);
-    pos += 8;
+    int32_t result = postgres::binary::read_be<int32_t>(message + pos);
+    pos += 4;
     return result;
 }
 
 int64_t logical_replication_parser::parse_int64(const char * message, size_t & pos, size_t size)
 {
-    if (size < pos + 16) {
+    if (size < pos + 8) {
         throw exception(error_codes::LOGICAL_ERROR, "Message small from parse int64");
     }
-    int64_t result = hex_n_char_to_t<int64_t>(message, pos, 8);
-    pos += 16;
+    int64_t result = postgres::binary::read_be<int64_t>(message + pos);
+    pos += 8;
     return result;
 }
 
 void logical_replication_parser::parse_string(const char * message, size_t & pos, size_t size, std::string & result)
 {
-    if (size < pos + 2) {
+    const char *end = static_cast<const char *>(std::memchr(message + pos, '\0', size - std::min(pos, size)));
+    if (!end) {
         throw exception(error_codes::LOGICAL_ERROR, "Message small from parse string");
     }
-    char current = hex_2_char_to_digit(message + pos);
-    pos += 2;
-    while (pos < size && current != '\0')
-    {
-        result += current;
-        current = hex_2_char_to_digit(message + pos);
-        pos += 2;
-    }
+    result.assign(message + pos, end);
+    pos = end - message + 1;
 }
 
 void logical_replication_parser::parse_change_data(const char *message,
                                                size_t &pos,
                                                size_t size,
-                                               std::vector<std::string>& result,
-                                               std::unordered_map<int32_t, std::string>& old_result,
-                                               bool old_value = false)
+                                               replication_row &row)
 {
     int16_t num_columns = parse_int16(message, pos, size);
-    result.resize(num_columns);
+    row.reset(num_columns);
 
-    auto proccess_column_value = [&](int8_t identifier_data, int16_t column_idx)
+    for (int16_t column_idx = 0; column_idx < num_columns; ++column_idx)
     {
-        current_logger->log_to_file(log_level::DEBUG, fmt::format("Identifier data: {}", identifier_data));
+        int8_t identifier_data = parse_int8(message, pos, size);
         switch (identifier_data)
         {
             case 'n': /// NULL
-            {
-                if (!old_value)
-                    result[column_idx] = emptyValue;
-
                 break;
-            }
-            case 't': /// Text
-            {
-                int32_t col_len = parse_int32(message, pos, size);
-                std::string value;
-                for (int32_t i = 0; i < col_len; ++i)
-                    value += static_cast<char>(parse_int8(message, pos, size));
-
-                if (old_value)
-                    old_result[column_idx] = value;
-                else
-                    result[column_idx] = value;
-                std::cout << "value: " << value << std::endl;
-                break;
-            }
             case 'u': /// Values that are too large (TOAST).
             {
                 current_logger->log_to_file(log_level::WARNING,
                             fmt::format("Values too large in column: {}", column_idx));
-                if (old_value)
-                    old_result[column_idx] = emptyValue;
-                else
-                    result[column_idx] = emptyValue;
+                row.set(column_idx, 'u', nullptr, 0);
                 break;
             }
-            case 'b': /// Binary data.
+            case 't': /// Text
+            case 'b': /// Binary data, network byte order, decoded by the converter.
             {
                 int32_t col_len = parse_int32(message, pos, size);
-                std::string binary_data;
-                binary_data.resize(col_len);
-
-                for (int32_t i = 0; i < col_len; ++i) {
-                    binary_data[i] = static_cast<char>(parse_int8(message, pos, size));
+                if (col_len < 0 || size < pos + col_len) {
+                    throw exception(error_codes::LOGICAL_ERROR,
+                                    fmt::format("Message small for value of column {}", column_idx));
                 }
-
-                if (old_value)
-                    old_result[column_idx] = std::move(binary_data);
-                else
-                    result[column_idx] = std::move(binary_data);
-
+                row.set(column_idx, identifier_data, message + pos, col_len);
+                pos += col_len;
                 break;
             }
             default:
             {
-                current_logger->log_to_file(log_level::WARNING, fmt::format("Unexpected identifier: {}", identifier_data));
-                break;
+                // Length of the value is unknown, the rest of the tuple can not be read
+                throw exception(error_codes::LOGICAL_ERROR,
+                                fmt::format("Unexpected identifier {} for column {}", identifier_data, column_idx));
             }
         }
-    };
-
-    for (int16_t column_idx = 0; column_idx < num_columns; ++column_idx)
-    {
-        try
-        {
-            proccess_column_value(parse_int8(message, pos, size), column_idx);
-        }
-        catch (std::exception &e)
-        {
-            current_logger->log_to_file(log_level::ERROR,
-                        fmt::format(
-                            "Got error while receiving value for column {} with {}",
-                            column_idx, e.what()));
-
-        }
     }
 }
 
@@ -192,14 +117,14 @@ void logical_replication_parser::parse_binary_data(const char *replication_messa
                                                size_t size,
                                                postgre_sql_type_operation& type_operation,
                                                int32_t& table_id,
-                                               std::vector<std::string>& result,
+                                               replication_row& result,
                                                std::unordered_map<int32_t, std::string>& id_to_table_name,
                                                std::unordered_set<int32_t>& id_skip_table_name,
                                                std::unordered_map<int32_t, std::vector<std::pair<std::string, int32_t>>>& id_table_to_column,
-                                               std::unordered_map<int32_t, std::string>& old_value)
+                                               std::unordered_map<int32_t, std::vector<int32_t>>& id_table_to_type_modifier,
+                                               replication_row& old_value)
 {
-    // Skip '\x'
-    size_t pos = 2;
+    size_t pos = 0;
     char type = parse_int8(replication_message, pos, size);
     current_logger->log_to_file(log_level::DEBUG, fmt::format("Message type: {}, lsn string: {}", type, *current_lsn));
 
@@ -209,13 +134,16 @@ void logical_replication_parser::parse_binary_data(const char *replication_messa
     {
         case 'B': // Begin
         {
-            parse_int64(replication_message, pos, size); // skip transaction end lsn
+            transaction_lsn = parse_int64(replication_message, pos, size);
             parse_int64(replication_message, pos, size); // skip timestamp transaction commit
             type_operation = postgre_sql_type_operation::NOT_PROCESSED;
             break;
         }
         case 'I': // Insert
         {
+            if (stream_active)
+                parse_int32(replication_message, pos, size); // skip xid of the streamed transaction
+
             table_id = parse_int32(replication_message, pos, size);
             const auto & table_name = id_to_table_name[table_id];
             current_logger->log_to_file(log_level::DEBUG, fmt::format("Table name for insert: ", table_name));
@@ -229,13 +157,16 @@ void logical_replication_parser::parse_binary_data(const char *replication_messa
             int8_t new_data = parse_int8(replication_message, pos, size);
 
             if (new_data) {
-                parse_change_data(replication_message, pos, size, result, old_value);
+                parse_change_data(replication_message, pos, size, result);
                 }
             type_operation = postgre_sql_type_operation::INSERT;
             break;
         }
         case 'U': // Update
         {
+            if (stream_active)
+                parse_int32(replication_message, pos, size); // skip xid of the streamed transaction
+
             table_id = parse_int32(replication_message, pos, size);
             const auto & table_name = id_to_table_name[table_id];
             current_logger->log_to_file(log_level::DEBUG, fmt::format("Table name for update: ", table_name));
@@ -253,12 +184,12 @@ void logical_replication_parser::parse_binary_data(const char *replication_messa
                 {
                     case 'K':
                     case 'O': {
-                        parse_change_data(replication_message, pos, size, result, old_value, true);
+                        parse_change_data(replication_message, pos, size, old_value);
                         break;
                     }
                     case 'N': {
                         /// New row.
-                        parse_change_data(replication_message, pos, size, result, old_value);
+                        parse_change_data(replication_message, pos, size, result);
                         read_next = false;
                         break;
                     }
@@ -278,6 +209,9 @@ void logical_replication_parser::parse_binary_data(const char *replication_messa
         }
         case 'D': // Delete
         {
+            if (stream_active)
+                parse_int32(replication_message, pos, size); // skip xid of the streamed transaction
+
             table_id = parse_int32(replication_message, pos, size);
             const auto & table_name = id_to_table_name[table_id];
             current_logger->log_to_file(log_level::DEBUG, fmt::format("Table name for delete: ", table_name));
@@ -292,25 +226,27 @@ void logical_replication_parser::parse_binary_data(const char *replication_messa
             // skip replica identity
             parse_int8(replication_message, pos, size);
 
-            parse_change_data(replication_message, pos, size, result, old_value);
+            parse_change_data(replication_message, pos, size, result);
             type_operation = postgre_sql_type_operation::DELETE;
             break;
         }
         case 'C': // Commit
         {
-            constexpr size_t unused_flags_len = 1;
-            constexpr size_t commit_lsn_len = 8;
-            constexpr size_t transaction_end_lsn_len = 8;
-            constexpr size_t transaction_commit_timestamp_len = 8;
-            pos += unused_flags_len + commit_lsn_len + transaction_end_lsn_len + transaction_commit_timestamp_len;
+            parse_int8(replication_message, pos, size); // skip unused flags
+            parse_int64(replication_message, pos, size); // skip commit lsn
+            uint64_t transaction_end_lsn = parse_int64(replication_message, pos, size);
+            parse_int64(replication_message, pos, size); // skip timestamp transaction commit
 
-            result_lsn = current_lsn;
+            *result_lsn = lsn_to_string(transaction_end_lsn);
             *is_committed = true;
             type_operation = postgre_sql_type_operation::NOT_PROCESSED;
             break;
         }
         case 'R': // Relation
         {
+            if (stream_active)
+                parse_int32(replication_message, pos, size); // skip xid of the streamed transaction
+
             table_id = parse_int32(replication_message, pos, size);
             current_logger->log_to_file(log_level::DEBUG, fmt::format("Table id: {}", table_id));
 
@@ -360,10 +296,10 @@ void logical_replication_parser::parse_binary_data(const char *replication_messa
             /// numeric - 1700
             /// uuid - 2950
             int32_t data_type_id;
-            int32_t type_modifier; // Дополнительные параметры типа
 
             std::vector<std::string> replication_columns;
             std::vector<std::pair<std::string, int32_t>> columns(num_columns);
+            std::vector<int32_t> type_modifiers(num_columns); // numeric(p, s), varchar(n), -1 without one
 
             for (uint16_t i = 0; i < num_columns; ++i)
             {
@@ -373,12 +309,47 @@ void logical_replication_parser::parse_binary_data(const char *replication_messa
                 current_logger->log_to_file(log_level::DEBUG, fmt::format("Column name: {}", column_name));
 
                 data_type_id = parse_int32(replication_message, pos, size);
-                type_modifier = parse_int32(replication_message, pos, size);
+                type_modifiers[i] = parse_int32(replication_message, pos, size);
 
                 columns[i] = {column_name, data_type_id};
                 replication_columns.emplace_back(column_name);
             }
             id_table_to_column[table_id] = columns;
+            id_table_to_type_modifier[table_id] = type_modifiers;
+            type_operation = postgre_sql_type_operation::NOT_PROCESSED;
+            break;
+        }
+        case 'S': // Stream Start
+        {
+            stream_xid = parse_int32(replication_message, pos, size);
+            parse_int8(replication_message, pos, size); // skip first segment flag
+            stream_active = true;
+            type_operation = postgre_sql_type_operation::NOT_PROCESSED;
+            break;
+        }
+        case 'E': // Stream Stop
+        {
+            stream_active = false;
+            type_operation = postgre_sql_type_operation::NOT_PROCESSED;
+            break;
+        }
+        case 'c': // Stream Commit
+        {
+            stream_xid = parse_int32(replication_message, pos, size);
+            parse_int8(replication_message, pos, size); // skip unused flags
+            transaction_lsn = parse_int64(replication_message, pos, size); // the spooled changes are replayed next
+            uint64_t transaction_end_lsn = parse_int64(replication_message, pos, size);
+            parse_int64(replication_message, pos, size); // skip timestamp transaction commit
+
+            *result_lsn = lsn_to_string(transaction_end_lsn);
+            *is_committed = true;
+            type_operation = postgre_sql_type_operation::NOT_PROCESSED;
+            break;
+        }
+        case 'A': // Stream Abort
+        {
+            stream_xid = parse_int32(replication_message, pos, size);
+            stream_subxid = parse_int32(replication_message, pos, size);
             type_operation = postgre_sql_type_operation::NOT_PROCESSED;
             break;
         }
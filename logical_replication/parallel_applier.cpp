@@ -0,0 +1,232 @@
+#include <algorithm>
+#include <string_view>
+#include <fmt/format.h>
+
+#include <logical_replication/parallel_applier.h>
+
+namespace {
+    uint64_t hash_combine(uint64_t seed, uint64_t value) {
+        return seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+    }
+}
+
+parallel_applier::parallel_applier(size_t workers_, size_t max_in_flight_, apply_function apply_, logger *logger_)
+    : max_in_flight(std::max<size_t>(max_in_flight_, 1)),
+      apply(std::move(apply_)),
+      current_logger(logger_) {
+    size_t worker_count = std::max<size_t>(workers_, 1);
+    workers.reserve(worker_count);
+    for (size_t i = 0; i < worker_count; ++i) {
+        workers.emplace_back(&parallel_applier::worker_loop, this, i);
+    }
+}
+
+parallel_applier::~parallel_applier() {
+    {
+        std::lock_guard guard(scheduler_mutex);
+        stopping = true;
+    }
+    ready_condition.notify_all();
+    capacity_condition.notify_all();
+
+    for (auto & worker : workers) {
+        worker.join();
+    }
+}
+
+bool parallel_applier::collect_keys(const decoded_change & change, std::vector<uint64_t> & keys) {
+    const relation_info & relation = *change.relation;
+    if (relation.primary_key.empty()) {
+        return false;
+    }
+
+    const uint64_t table_hash = std::hash<int32_t>{}(relation.table_id);
+
+    uint64_t new_key = table_hash;
+    for (int32_t column : relation.primary_key) {
+        if (column >= static_cast<int32_t>(change.result.size())) {
+            return false;
+        }
+        const replication_value value = change.result[column];
+        new_key = hash_combine(new_key, std::hash<std::string_view>{}(value.data));
+        new_key = hash_combine(new_key, static_cast<uint64_t>(value.kind));
+    }
+    keys.push_back(new_key);
+
+    // Update of the key itself: the old row conflicts too
+    if (!change.old_value.empty()) {
+        uint64_t old_key = table_hash;
+        for (int32_t column : relation.primary_key) {
+            if (column >= static_cast<int32_t>(change.old_value.size()) || change.old_value.is_null(column)) {
+                return true;
+            }
+            const replication_value value = change.old_value[column];
+            old_key = hash_combine(old_key, std::hash<std::string_view>{}(value.data));
+            old_key = hash_combine(old_key, static_cast<uint64_t>(value.kind));
+        }
+        if (old_key != new_key) {
+            keys.push_back(old_key);
+        }
+    }
+
+    return true;
+}
+
+void parallel_applier::submit(decoded_change && change) {
+    const uint64_t commit_lsn = change.commit_lsn;
+    if (change.type_operation != postgre_sql_type_operation::NOT_PROCESSED) {
+        open_changes.push_back(std::move(change));
+    }
+
+    if (commit_lsn == 0) {
+        return;
+    }
+
+    auto txn = std::make_shared<transaction>();
+    txn->sequence = next_sequence++;
+    txn->commit_lsn = commit_lsn;
+    txn->changes = std::move(open_changes);
+    open_changes.clear();
+
+    for (const auto & txn_change : txn->changes) {
+        if (!collect_keys(txn_change, txn->keys)) {
+            txn->barrier = true;
+        }
+    }
+
+    if (txn->barrier) {
+        txn->keys.clear();
+    } else {
+        std::sort(txn->keys.begin(), txn->keys.end());
+        txn->keys.erase(std::unique(txn->keys.begin(), txn->keys.end()), txn->keys.end());
+    }
+
+    schedule(std::move(txn));
+}
+
+void parallel_applier::schedule(transaction_ptr txn) {
+    std::unique_lock lock(scheduler_mutex);
+    capacity_condition.wait(lock, [this] { return stopping || pending.size() < max_in_flight; });
+    if (stopping) {
+        return;
+    }
+
+    if (txn->changes.empty()) {
+        // Nothing to apply, only keeps its place in the acknowledgement order.
+        // It is never a dependency, so nothing waits on it
+        txn->done = true;
+        pending.emplace(txn->sequence, std::move(txn));
+        release_applied();
+        return;
+    }
+
+    std::vector<transaction_ptr> dependencies;
+    auto add_dependency = [&](const transaction_ptr & dependency) {
+        if (dependency && !dependency->done
+            && std::find(dependencies.begin(), dependencies.end(), dependency) == dependencies.end()) {
+            dependencies.push_back(dependency);
+        }
+    };
+
+    if (txn->barrier) {
+        for (const auto & [sequence, earlier] : pending) {
+            add_dependency(earlier);
+        }
+        last_barrier = txn;
+    } else {
+        add_dependency(last_barrier);
+        for (uint64_t key : txn->keys) {
+            auto [it, inserted] = last_writer.try_emplace(key, txn);
+            if (!inserted) {
+                add_dependency(it->second);
+                it->second = txn;
+            }
+        }
+    }
+
+    for (const auto & dependency : dependencies) {
+        dependency->dependents.push_back(txn);
+    }
+    txn->pending_dependencies = dependencies.size();
+    pending.emplace(txn->sequence, txn);
+
+    if (txn->pending_dependencies == 0) {
+        ready.push_back(std::move(txn));
+        ready_condition.notify_one();
+    }
+}
+
+void parallel_applier::complete(const transaction_ptr & txn) {
+    std::lock_guard guard(scheduler_mutex);
+    txn->done = true;
+    txn->changes.clear();
+
+    for (const auto & dependent : txn->dependents) {
+        if (--dependent->pending_dependencies == 0) {
+            ready.push_back(dependent);
+            ready_condition.notify_one();
+        }
+    }
+    txn->dependents.clear();
+
+    for (uint64_t key : txn->keys) {
+        auto it = last_writer.find(key);
+        if (it != last_writer.end() && it->second == txn) {
+            last_writer.erase(it);
+        }
+    }
+    if (last_barrier == txn) {
+        last_barrier.reset();
+    }
+
+    release_applied();
+}
+
+void parallel_applier::release_applied() {
+    while (!pending.empty() && pending.begin()->second->done) {
+        applied_lsn = pending.begin()->second->commit_lsn;
+        pending.erase(pending.begin());
+    }
+
+    capacity_condition.notify_all();
+    if (pending.empty()) {
+        idle_condition.notify_all();
+    }
+}
+
+void parallel_applier::worker_loop(size_t worker) {
+    while (true) {
+        transaction_ptr txn;
+        {
+            std::unique_lock lock(scheduler_mutex);
+            ready_condition.wait(lock, [this] { return stopping || !ready.empty(); });
+            if (stopping) {
+                return;
+            }
+            txn = std::move(ready.front());
+            ready.pop_front();
+        }
+
+        apply(worker, txn->changes);
+
+        complete(txn);
+    }
+}
+
+void parallel_applier::discard_open_transaction() {
+    if (!open_changes.empty()) {
+        current_logger->log_to_file(log_level::DEBUG, fmt::format(
+                       "Dropping {} changes of an unfinished transaction", open_changes.size()));
+    }
+    open_changes.clear();
+}
+
+void parallel_applier::wait_idle() {
+    std::unique_lock lock(scheduler_mutex);
+    idle_condition.wait(lock, [this] { return stopping || pending.empty(); });
+}
+
+size_t parallel_applier::in_flight() const {
+    std::lock_guard guard(scheduler_mutex);
+    return pending.size();
+}
@@ -0,0 +1,172 @@
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <unordered_set>
+#include <fmt/format.h>
+
+#include <logical_replication/snapshot_checkpoint.h>
+#include <common/exception.h>
+
+snapshot_checkpoint::snapshot_checkpoint(std::filesystem::path path_, logger *logger_)
+    : path(std::move(path_)),
+      current_logger(logger_) {
+}
+
+bool snapshot_checkpoint::load() {
+    std::lock_guard guard(checkpoint_mutex);
+    if (path.empty() || !std::filesystem::exists(path)) {
+        return false;
+    }
+
+    std::ifstream input(path);
+    std::string line;
+    std::vector<snapshot_task> loaded_tasks;
+    bool loaded_complete = false;
+    bool loaded_streamed = false;
+    uint64_t loaded_reconcile_lsn = 0;
+    std::string loaded_slot, loaded_snapshot, loaded_lsn;
+
+    // Tab separated: slot, snapshot, lsn, reconcile, streamed and complete lines, then one line per task
+    while (std::getline(input, line)) {
+        std::vector<std::string> fields;
+        std::stringstream ss(line);
+        std::string field;
+        while (std::getline(ss, field, '\t')) {
+            fields.push_back(field);
+        }
+        if (fields.empty()) {
+            continue;
+        }
+
+        try {
+            if (fields[0] == "slot" && fields.size() == 2) {
+                loaded_slot = fields[1];
+            } else if (fields[0] == "snapshot" && fields.size() == 2) {
+                loaded_snapshot = fields[1];
+            } else if (fields[0] == "lsn" && fields.size() == 2) {
+                loaded_lsn = fields[1];
+            } else if (fields[0] == "reconcile" && fields.size() == 2) {
+                loaded_reconcile_lsn = std::stoull(fields[1]);
+            } else if (fields[0] == "streamed" && fields.size() == 2) {
+                loaded_streamed = fields[1] == "1";
+            } else if (fields[0] == "complete" && fields.size() == 2) {
+                loaded_complete = fields[1] == "1";
+            } else if (fields[0] == "task" && fields.size() >= 6) {
+                snapshot_task task;
+                task.done = fields[1] == "1";
+                task.rows_done = std::stoull(fields[2]);
+                task.size_bytes = std::stoull(fields[3]);
+                task.memory_bytes = std::stoull(fields[4]);
+                task.table_name = fields[5];
+                task.condition = fields.size() > 6 ? fields[6] : "";
+                task.resume_after = fields.size() > 7 ? fields[7] : "";
+                // Files without the bound restart the task from its first row
+                task.replace = fields.size() > 8 ? fields[8] == "1" : !task.done && task.rows_done != 0;
+                loaded_tasks.push_back(std::move(task));
+            } else {
+                throw exception(error_codes::INVALID_INPUT, fmt::format("Unexpected line: {}", line));
+            }
+        } catch (const std::exception & e) {
+            current_logger->log_to_file(log_level::WARNING, fmt::format(
+                           "Ignoring snapshot state file {}: {}", path.string(), e.what()));
+            return false;
+        }
+    }
+
+    if (loaded_slot.empty() || loaded_snapshot.empty() || loaded_lsn.empty()) {
+        current_logger->log_to_file(log_level::WARNING, fmt::format(
+                       "Ignoring incomplete snapshot state file {}", path.string()));
+        return false;
+    }
+
+    slot_name = std::move(loaded_slot);
+    snapshot_name = std::move(loaded_snapshot);
+    start_lsn = std::move(loaded_lsn);
+    tasks = std::move(loaded_tasks);
+    reconcile_lsn = loaded_reconcile_lsn;
+    streamed = loaded_streamed;
+    complete = loaded_complete;
+    return true;
+}
+
+void snapshot_checkpoint::start(const std::string & slot_name_, const std::string & snapshot_name_,
+                                const std::string & start_lsn_, std::vector<snapshot_task> tasks_, bool streamed_) {
+    std::lock_guard guard(checkpoint_mutex);
+    slot_name = slot_name_;
+    snapshot_name = snapshot_name_;
+    start_lsn = start_lsn_;
+    tasks = std::move(tasks_);
+    reconcile_lsn = 0;
+    streamed = streamed_;
+    complete = false;
+    save();
+}
+
+void snapshot_checkpoint::resume(const std::string & snapshot_name_, bool newer_snapshot, uint64_t reconcile_lsn_) {
+    std::lock_guard guard(checkpoint_mutex);
+    if (newer_snapshot) {
+        std::unordered_set<std::string> written_tables;
+        for (const auto & task : tasks) {
+            if (task.done || task.rows_done != 0) {
+                written_tables.insert(task.table_name);
+            }
+        }
+        for (auto & task : tasks) {
+            task.replace = task.replace || written_tables.contains(task.table_name);
+        }
+    }
+
+    snapshot_name = snapshot_name_;
+    reconcile_lsn = std::max(reconcile_lsn, reconcile_lsn_);
+    save();
+}
+
+void snapshot_checkpoint::chunk_done(size_t task, uint64_t rows, const std::string & last_ctid) {
+    std::lock_guard guard(checkpoint_mutex);
+    tasks.at(task).rows_done = rows;
+    tasks.at(task).resume_after = last_ctid;
+    save();
+}
+
+void snapshot_checkpoint::task_done(size_t task, uint64_t rows) {
+    std::lock_guard guard(checkpoint_mutex);
+    tasks.at(task).rows_done = rows;
+    tasks.at(task).done = true;
+    save();
+}
+
+void snapshot_checkpoint::finish() {
+    std::lock_guard guard(checkpoint_mutex);
+    complete = true;
+    save();
+}
+
+void snapshot_checkpoint::save() {
+    if (path.empty()) {
+        return;
+    }
+
+    std::filesystem::create_directories(path.parent_path());
+    std::filesystem::path temporary_path = path;
+    temporary_path += ".tmp";
+    {
+        std::ofstream output(temporary_path, std::ios::trunc);
+        output << "slot\t" << slot_name << '\n'
+               << "snapshot\t" << snapshot_name << '\n'
+               << "lsn\t" << start_lsn << '\n'
+               << "reconcile\t" << reconcile_lsn << '\n'
+               << "streamed\t" << (streamed ? 1 : 0) << '\n'
+               << "complete\t" << (complete ? 1 : 0) << '\n';
+        for (const auto & task : tasks) {
+            output << "task\t" << (task.done ? 1 : 0) << '\t' << task.rows_done << '\t' << task.size_bytes << '\t'
+                   << task.memory_bytes << '\t' << task.table_name << '\t' << task.condition << '\t'
+                   << task.resume_after << '\t' << (task.replace ? 1 : 0) << '\n';
+        }
+        output.flush();
+        if (!output) {
+            throw exception(error_codes::LOGICAL_ERROR,
+                            fmt::format("Failed to write snapshot state file {}", temporary_path.string()));
+        }
+    }
+    std::filesystem::rename(temporary_path, path);
+}
@@ -0,0 +1,127 @@
+#include <algorithm>
+#include <fmt/format.h>
+
+#include <logical_replication/transaction_spool.h>
+#include <common/exception.h>
+
+transaction_spool::transaction_spool(const std::filesystem::path & directory_, const std::string & prefix_, logger *logger_)
+    : directory(directory_),
+      prefix(prefix_),
+      current_logger(logger_) {
+    std::filesystem::create_directories(directory);
+
+    // Streamed transactions are sent again from the confirmed lsn, leftovers of a previous run are useless
+    for (const auto & entry : std::filesystem::directory_iterator(directory)) {
+        const std::string file_name = entry.path().filename().string();
+        if (entry.is_regular_file() && file_name.starts_with(prefix + "_") && entry.path().extension() == ".spool") {
+            std::filesystem::remove(entry.path());
+        }
+    }
+}
+
+transaction_spool::~transaction_spool() {
+    for (auto & [xid, file] : files) {
+        file.stream.close();
+        std::error_code error;
+        std::filesystem::remove(file.path, error);
+    }
+}
+
+std::filesystem::path transaction_spool::get_path(uint32_t xid) const {
+    return directory / fmt::format("{}_{}.spool", prefix, xid);
+}
+
+void transaction_spool::append(uint32_t xid, uint32_t subxid, const char *message, size_t size) {
+    auto [it, inserted] = files.try_emplace(xid);
+    spool_file & file = it->second;
+
+    if (inserted) {
+        file.path = get_path(xid);
+        file.stream.open(file.path, std::ios::binary | std::ios::trunc);
+        current_logger->log_to_file(log_level::DEBUG, fmt::format("Spooling streamed transaction {}", xid));
+    }
+
+    if (file.subxid_offsets.empty() || file.subxid_offsets.back().first != subxid) {
+        if (std::none_of(file.subxid_offsets.begin(), file.subxid_offsets.end(),
+                         [subxid](const auto & entry) { return entry.first == subxid; })) {
+            file.subxid_offsets.emplace_back(subxid, file.bytes);
+        }
+    }
+
+    auto length = static_cast<uint32_t>(size);
+    file.stream.write(reinterpret_cast<const char *>(&length), sizeof(length));
+    file.stream.write(message, static_cast<std::streamsize>(size));
+    if (!file.stream) {
+        throw exception(error_codes::LOGICAL_ERROR,
+                        fmt::format("Failed to write spool file {}", file.path.string()));
+    }
+    file.bytes += sizeof(length) + size;
+}
+
+void transaction_spool::replay(uint32_t xid, const message_handler & handler) {
+    auto it = files.find(xid);
+    if (it == files.end()) {
+        current_logger->log_to_file(log_level::DEBUG, fmt::format("Nothing spooled for transaction {}", xid));
+        return;
+    }
+
+    it->second.stream.close();
+
+    std::ifstream input(it->second.path, std::ios::binary);
+    uint32_t length = 0;
+    size_t messages = 0;
+    while (input.read(reinterpret_cast<char *>(&length), sizeof(length))) {
+        read_buffer.resize(length);
+        if (!input.read(read_buffer.data(), length)) {
+            throw exception(error_codes::LOGICAL_ERROR,
+                            fmt::format("Truncated spool file {}", it->second.path.string()));
+        }
+        handler(read_buffer.data(), read_buffer.size());
+        ++messages;
+    }
+
+    current_logger->log_to_file(log_level::DEBUG, fmt::format(
+                   "Replayed {} messages of streamed transaction {}", messages, xid));
+    remove(xid);
+}
+
+void transaction_spool::abort(uint32_t xid, uint32_t subxid) {
+    auto it = files.find(xid);
+    if (it == files.end()) {
+        return;
+    }
+
+    if (xid == subxid) {
+        current_logger->log_to_file(log_level::DEBUG, fmt::format("Streamed transaction {} aborted", xid));
+        remove(xid);
+        return;
+    }
+
+    spool_file & file = it->second;
+    auto subxid_it = std::find_if(file.subxid_offsets.begin(), file.subxid_offsets.end(),
+                                  [subxid](const auto & entry) { return entry.first == subxid; });
+    if (subxid_it == file.subxid_offsets.end()) {
+        return;
+    }
+
+    // Sub-transactions after the aborted one are its children, they are rolled back as well
+    file.stream.close();
+    file.bytes = subxid_it->second;
+    std::filesystem::resize_file(file.path, file.bytes);
+    file.subxid_offsets.erase(subxid_it, file.subxid_offsets.end());
+    file.stream.open(file.path, std::ios::binary | std::ios::app);
+
+    current_logger->log_to_file(log_level::DEBUG, fmt::format(
+                   "Sub-transaction {} of streamed transaction {} aborted", subxid, xid));
+}
+
+void transaction_spool::remove(uint32_t xid) {
+    auto it = files.find(xid);
+    if (it == files.end()) {
+        return;
+    }
+
+    it->second.stream.close();
+    std::filesystem::remove(it->second.path);
+    files.erase(it);
+}
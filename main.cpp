@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -17,7 +18,31 @@ int main(int argc, char* argv[]) {
     std::string url_log = "";
     std::string user_snapshot = "";
     bool user_managed_slot = false;
+    bool streaming = false;
+    bool binary = false;
+    bool streaming_transactions = false;
+    std::string spool_directory = "";
     int batch_size = 100;
+    bool adaptive_batch = false;
+    size_t min_batch_size = 10;
+    size_t max_batch_size = 100000;
+    int target_batch_latency_ms = 500;
+    size_t memory_limit_mb = 0;
+    bool pipelined = false;
+    size_t pipeline_queue_size = 10000;
+    size_t apply_workers = 1;
+    size_t max_in_flight_transactions = 1000;
+    size_t shards = 1;
+    size_t apply_batch_rows = 0;
+    size_t snapshot_chunk_rows = 10000;
+    size_t snapshot_workers = 1;
+    size_t snapshot_memory_budget_mb = 0;
+    size_t snapshot_split_mb = 0;
+    std::string state_directory = "";
+    bool concurrent_snapshot = false;
+    size_t held_changes_limit_mb = 1024;
+    int apply_batch_delay_ms = 100;
+    int metrics_interval_s = 60;
 
     po::options_description desc("Allowed options for Logical Replication Handler");
     desc.add_options()
@@ -38,8 +63,56 @@ int main(int argc, char* argv[]) {
             "User managed slot")
         ("user_snapshot", po::value<std::string>(&user_snapshot)->default_value(user_snapshot),
             "User snapshot name")
+        ("streaming", po::value<bool>(&streaming)->default_value(streaming),
+            "Read changes with START_REPLICATION instead of polling the slot")
+        ("binary", po::value<bool>(&binary)->default_value(binary),
+            "Receive column values in binary format (PostgreSQL 14+)")
+        ("streaming_transactions", po::value<bool>(&streaming_transactions)->default_value(streaming_transactions),
+            "Receive large in-progress transactions as they run (PostgreSQL 14+)")
+        ("spool_directory", po::value<std::string>(&spool_directory)->default_value(spool_directory),
+            "Directory for spooled streamed transactions (leave empty for the temp directory)")
         ("batchsize,b", po::value<int>(&batch_size)->default_value(batch_size),
-            "Batch size for processing changes");
+            "Batch size for processing changes (initial value with --adaptive_batch)")
+        ("adaptive_batch", po::value<bool>(&adaptive_batch)->default_value(adaptive_batch),
+            "Adjust the batch size to apply latency, slot lag and memory use")
+        ("min_batchsize", po::value<size_t>(&min_batch_size)->default_value(min_batch_size),
+            "Lower bound of the adaptive batch size")
+        ("max_batchsize", po::value<size_t>(&max_batch_size)->default_value(max_batch_size),
+            "Upper bound of the adaptive batch size")
+        ("target_batch_latency_ms", po::value<int>(&target_batch_latency_ms)->default_value(target_batch_latency_ms),
+            "Apply time of one batch the adaptive batch size aims for")
+        ("memory_limit_mb", po::value<size_t>(&memory_limit_mb)->default_value(memory_limit_mb),
+            "Resident memory above which the adaptive batch size shrinks (0 disables)")
+        ("pipelined", po::value<bool>(&pipelined)->default_value(pipelined),
+            "Fetch, decode and apply changes on separate threads (streaming mode)")
+        ("pipeline_queue_size", po::value<size_t>(&pipeline_queue_size)->default_value(pipeline_queue_size),
+            "Capacity of each pipeline queue in messages")
+        ("apply_workers", po::value<size_t>(&apply_workers)->default_value(apply_workers),
+            "Apply transactions with disjoint primary keys on this many workers")
+        ("max_in_flight_transactions", po::value<size_t>(&max_in_flight_transactions)->default_value(max_in_flight_transactions),
+            "Committed transactions queued for parallel apply before fetching pauses")
+        ("shards", po::value<size_t>(&shards)->default_value(shards),
+            "Split the tables into this many publications and slots, each consumed on its own thread")
+        ("apply_batch_rows", po::value<size_t>(&apply_batch_rows)->default_value(apply_batch_rows),
+            "Write inserts and deletes of a table in batches of up to this many rows (0 disables)")
+        ("apply_batch_delay_ms", po::value<int>(&apply_batch_delay_ms)->default_value(apply_batch_delay_ms),
+            "Longest time changes wait in an apply batch")
+        ("snapshot_chunk_rows", po::value<size_t>(&snapshot_chunk_rows)->default_value(snapshot_chunk_rows),
+            "Rows of the initial load converted and written at a time")
+        ("snapshot_workers", po::value<size_t>(&snapshot_workers)->default_value(snapshot_workers),
+            "Connections loading tables of the initial snapshot concurrently")
+        ("snapshot_memory_budget_mb", po::value<size_t>(&snapshot_memory_budget_mb)->default_value(snapshot_memory_budget_mb),
+            "Estimated memory of concurrently loaded snapshot chunks (0 disables)")
+        ("snapshot_split_mb", po::value<size_t>(&snapshot_split_mb)->default_value(snapshot_split_mb),
+            "Split tables larger than this into ctid ranges loaded in parallel (0 disables)")
+        ("state_directory", po::value<std::string>(&state_directory)->default_value(state_directory),
+            "Directory for initial load progress and applied lsn (leave empty for the temp directory)")
+        ("concurrent_snapshot", po::value<bool>(&concurrent_snapshot)->default_value(concurrent_snapshot),
+            "Stream changes while the initial load runs, holding those of tables still loading (streaming mode)")
+        ("held_changes_limit_mb", po::value<size_t>(&held_changes_limit_mb)->default_value(held_changes_limit_mb),
+            "Held changes of loading tables above which streaming waits for a load to finish (0 disables)")
+        ("metrics_interval_s", po::value<int>(&metrics_interval_s)->default_value(metrics_interval_s),
+            "How often the metrics are written to the log (0 disables)");
 
     po::variables_map vm;
     try {
@@ -75,6 +148,39 @@ int main(int argc, char* argv[]) {
         return 0;
     }
 
+    if (min_batch_size > max_batch_size) {
+        std::cerr << "Error: --min_batchsize is above --max_batchsize.\n\n" << desc << "\n";
+        return 1;
+    }
+
+    replication_settings settings;
+    settings.mode = streaming ? replication_mode::STREAMING : replication_mode::POLLING;
+    settings.binary = binary;
+    settings.streaming_transactions = streaming_transactions;
+    if (!spool_directory.empty())
+        settings.spool_directory = spool_directory;
+    settings.adaptive_batch.enabled = adaptive_batch;
+    settings.adaptive_batch.min_block_size = min_batch_size;
+    settings.adaptive_batch.max_block_size = max_batch_size;
+    settings.adaptive_batch.target_latency = std::chrono::milliseconds(target_batch_latency_ms);
+    settings.adaptive_batch.memory_limit_bytes = memory_limit_mb * 1024 * 1024;
+    settings.pipelined = pipelined;
+    settings.pipeline_queue_size = pipeline_queue_size;
+    settings.apply_workers = apply_workers;
+    settings.max_in_flight_transactions = max_in_flight_transactions;
+    settings.shard_count = shards;
+    settings.apply_batch_rows = apply_batch_rows;
+    settings.apply_batch_delay = std::chrono::milliseconds(apply_batch_delay_ms);
+    settings.snapshot_chunk_rows = snapshot_chunk_rows;
+    settings.snapshot_workers = snapshot_workers;
+    settings.snapshot_memory_budget_bytes = snapshot_memory_budget_mb * 1024 * 1024;
+    settings.snapshot_split_bytes = static_cast<uint64_t>(snapshot_split_mb) * 1024 * 1024;
+    if (!state_directory.empty())
+        settings.state_directory = state_directory;
+    settings.concurrent_snapshot = concurrent_snapshot;
+    settings.held_changes_limit_bytes = static_cast<uint64_t>(held_changes_limit_mb) * 1024 * 1024;
+    settings.metrics_interval = std::chrono::seconds(std::max(metrics_interval_s, 0));
+
     try {
         logical_replication_handler logical_replication_handler(
         database,
@@ -83,9 +189,10 @@ int main(int argc, char* argv[]) {
         logfile,
         url_log,
         tables,
-        100,
+        batch_size,
         user_managed_slot,
-        user_snapshot);
+        user_snapshot,
+        settings);
 
         logical_replication_handler.start_synchronization();
 
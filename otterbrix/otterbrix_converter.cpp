@@ -1,534 +1,582 @@
-#include <functional>
-#include <sstream>
+#include <charconv>
+#include <absl/numeric/int128.h>
+#include <fmt/format.h>
 
 #include <otterbrix/document_types.h>
 #include <otterbrix/otterbrix_converter.h>
-#include <logical_replication/logical_replication_parser.h>
 #include <postgres/postgres_types.h>
-
-using logical_replication_to_otterbrix_doc = std::function<void(components::document::document_ptr,
-                                                                const std::vector<std::string> &)>;
-using logical_replication_to_otterbrix_doc_impl =
-    std::function<void(
-        components::document::document_ptr,
-        const std::string &,
-        const std::vector<std::string> &,
-        const int16_t &)>;
-
-using postgres_to_otterbrix_doc = std::function<void(components::document::document_ptr, const pqxx::row &)>;
-using postgres_to_otterbrix_doc_impl =
-    std::function<void(
-        components::document::document_ptr,
-        const std::string &,
-        const pqxx::row &,
-        size_t)>;
+#include <postgres/postgres_binary.h>
+#include <postgres/postgres_array.h>
+#include <postgres/postgres_numeric.h>
+#include <postgres/postgres_datetime.h>
+#include <postgres/postgres_json.h>
+#include <common/hex_decoder.h>
+#include <common/exception.h>
 
 namespace {
-    std::vector<std::string> parse_string(const std::string& input) {
-        std::vector<std::string> result;
+    /// Whole text of a number in the C locale; PostgreSQL never pads numbers or writes a '+'.
+    template<typename T>
+    T parse_number(std::string_view text) {
+        T number{};
+        const char *end = text.data() + text.size();
+        auto [stop, error] = std::from_chars(text.data(), end, number);
+        if (error != std::errc{} || stop != end) {
+            throw exception(error_codes::INVALID_INPUT, fmt::format("Invalid number: {}", text));
+        }
+        return number;
+    }
 
-        std::string cleanedInput = input;
-        if (cleanedInput.front() == '{') {
-            cleanedInput.erase(cleanedInput.begin());
-        }
-        if (cleanedInput.back() == '}') {
-            cleanedInput.erase(cleanedInput.end() - 1);
-        }
+    int64_t read_integer(const replication_value &value) {
+        return value.is_binary()
+            ? postgres::binary::read_integer(value.data)
+            : parse_number<int64_t>(value.data);
+    }
 
-        std::stringstream ss(cleanedInput);
-        std::string item;
+    absl::int128 read_decimal(const replication_value &value, int32_t scale) {
+        const postgres::numeric::int128 unscaled = value.is_binary()
+            ? postgres::numeric::read_binary(value.data, scale)
+            : postgres::numeric::parse_text(value.data, scale);
+        return absl::MakeInt128(static_cast<int64_t>(unscaled >> 64), static_cast<uint64_t>(unscaled));
+    }
 
-        while (std::getline(ss, item, ',')) {
-            result.push_back(item);
-        }
+    std::string read_numeric(const replication_value &value) {
+        return value.is_binary()
+            ? postgres::numeric::binary_to_string(value.data)
+            : std::string(value.data);
+    }
 
-        return result;
+    float read_float(const replication_value &value) {
+        return value.is_binary()
+            ? postgres::binary::read_float4(value.data)
+            : parse_number<float>(value.data);
     }
 
-    void
-    set_int8(components::document::document_ptr doc,
-             const std::string &name,
-             const std::vector<std::string> &result,
-             const int16_t &index)
-    {
-        if (result[index] == emptyValue) {
-            doc->set(name, nullptr);
-            return;
-        }
-        int64_t int_value = std::stoll(result[index]);
-        doc->set<int8_t>(name, int_value);
+    double read_double(const replication_value &value) {
+        return value.is_binary()
+            ? postgres::binary::read_float8(value.data)
+            : parse_number<double>(value.data);
     }
 
-    void
-    set_int16(components::document::document_ptr doc,
-              const std::string &name,
-              const std::vector<std::string> &result,
-              const int16_t &index)
-    {
-        if (result[index] == emptyValue) {
-            doc->set(name, nullptr);
-            return;
-        }
-        int64_t int_value = std::stoll(result[index]);
-        doc->set<int16_t>(name, int_value);
+    bool read_bool(const replication_value &value) {
+        return value.is_binary()
+            ? postgres::binary::read_bool(value.data)
+            : value.data == "1" || value.data == "t" || value.data == "true";
     }
 
-    void
-    set_int32(components::document::document_ptr doc,
-              const std::string &name,
-              const std::vector<std::string> &result,
-              const int16_t &index)
-    {
-        if (result[index] == emptyValue) {
-            doc->set(name, nullptr);
-            return;
+    /// 16 bytes; the text form is 32 hex digits with '-' between the groups.
+    std::string read_uuid(const replication_value &value) {
+        if (value.is_binary()) {
+            if (value.data.size() != 16) {
+                throw exception(error_codes::INVALID_INPUT, "Invalid binary uuid length");
+            }
+            return std::string(value.data);
         }
-        int64_t int_value = std::stoll(result[index]);
-        doc->set<int32_t>(name, int_value);
-    }
 
-    void
-    set_int64(components::document::document_ptr doc,
-              const std::string &name,
-              const std::vector<std::string> &result,
-              const int16_t &index)
-    {
-        if (result[index] == emptyValue) {
-            doc->set(name, nullptr);
-            return;
+        char digits[32];
+        size_t count = 0;
+        for (char c : value.data) {
+            if (c == '-') {
+                continue;
+            }
+            if (count == sizeof(digits)) {
+                throw exception(error_codes::INVALID_INPUT, fmt::format("Invalid uuid: {}", value.data));
+            }
+            digits[count++] = c;
+        }
+        if (count != sizeof(digits)) {
+            throw exception(error_codes::INVALID_INPUT, fmt::format("Invalid uuid: {}", value.data));
         }
-        int64_t int_value = std::stoll(result[index]);
-        doc->set<int64_t>(name, int_value);
+        std::string result(16, '\0');
+        hex::decode(digits, count, result.data());
+        return result;
     }
 
-    void
-    set_float(components::document::document_ptr doc,
-              const std::string &name,
-              const std::vector<std::string> &result,
-              const int16_t &index)
-    {
-        if (result[index] == emptyValue) {
-            doc->set(name, nullptr);
-            return;
+    /// bytea text form is '\x' and hex digits, the default bytea_output.
+    std::string read_bytes(const replication_value &value) {
+        if (value.is_binary()) {
+            return std::string(value.data);
         }
-        float float_value = std::stof(result[index]);
-        doc->set<float>(name, float_value);
+        std::string result;
+        hex::decode_bytea(value.data.data(), value.data.size(), result);
+        return result;
     }
 
-    void
-    set_double(components::document::document_ptr doc,
-               const std::string &name,
-               const std::vector<std::string> &result,
-               const int16_t &index) {
-        if (result[index] == emptyValue) {
-            doc->set(name, nullptr);
-            return;
-        }
-        double double_value = std::stod(result[index]);
-        doc->set<double>(name, double_value);
+    int32_t read_date(const replication_value &value) {
+        return value.is_binary()
+            ? postgres::datetime::read_date(value.data)
+            : postgres::datetime::parse_date(value.data);
     }
 
-    void
-    set_bit(components::document::document_ptr doc,
-            const std::string &name,
-            const std::vector<std::string> &result,
-            const int16_t &index) {
-        if (result[index] == emptyValue) {
-            doc->set(name, nullptr);
-            return;
-        }
-        if (result[index] == "1" || result[index] == "true") {
-            doc->set<bool>(name, true);
-        } else {
-            doc->set<bool>(name, false);
-        }
+    int64_t read_time(const replication_value &value) {
+        return value.is_binary()
+            ? postgres::datetime::read_time(value.data)
+            : postgres::datetime::parse_time(value.data);
     }
 
-    void
-    set_string(components::document::document_ptr doc,
-               const std::string &name,
-               const std::vector<std::string> &result,
-               const int16_t &index) {
-        if (result[index] == emptyValue) {
-            doc->set(name, nullptr);
-            return;
-        }
-        doc->set<std::string>(name, result[index]);
+    int64_t read_timestamp(const replication_value &value) {
+        return value.is_binary()
+            ? postgres::datetime::read_timestamp(value.data)
+            : postgres::datetime::parse_timestamp(value.data);
     }
 
-    logical_replication_to_otterbrix_doc_impl type_to_translator_array(const int32_t& type) {
+    tsl::column_op scalar_op(int32_t type, document_types &document_type) {
         switch (type) {
-            case static_cast<int32_t>(postgres_array_types::BIT):
-            case static_cast<int32_t>(postgres_array_types::BOOL):
-                return set_bit;
-            case static_cast<int32_t>(postgres_array_types::INT8):
-            case static_cast<int32_t>(postgres_array_types::INT2):
-            case static_cast<int32_t>(postgres_array_types::INT4):
-                return set_int8;
-            case static_cast<int32_t>(postgres_array_types::CHAR):
-            case static_cast<int32_t>(postgres_array_types::TEXT):
-            case static_cast<int32_t>(postgres_array_types::VARCHAR):
-            case static_cast<int32_t>(postgres_array_types::UUID):
-                return set_string;
-            case static_cast<int32_t>(postgres_array_types::FLOAT):
-                return set_float;
-            case static_cast<int32_t>(postgres_array_types::DOUBLE):
-                return set_double;
-            case static_cast<int32_t>(postgres_array_types::NUMERIC):
-                return set_int64;
+            case static_cast<int32_t>(postgres_types::INT2):
+                document_type = document_types::INT16;
+                return tsl::column_op::INT16;
+            case static_cast<int32_t>(postgres_types::INT4):
+                document_type = document_types::INT32;
+                return tsl::column_op::INT32;
+            case static_cast<int32_t>(postgres_types::INT8):
+                document_type = document_types::INT64;
+                return tsl::column_op::INT64;
+            case static_cast<int32_t>(postgres_types::NUMERIC):
+                document_type = document_types::STRING;
+                return tsl::column_op::NUMERIC;
+            case static_cast<int32_t>(postgres_types::BOOL):
+            case static_cast<int32_t>(postgres_types::BIT):
+                document_type = document_types::BOOL;
+                return tsl::column_op::BOOL;
+            case static_cast<int32_t>(postgres_types::FLOAT):
+                document_type = document_types::FLOAT;
+                return tsl::column_op::FLOAT;
+            case static_cast<int32_t>(postgres_types::DOUBLE):
+                document_type = document_types::DOUBLE;
+                return tsl::column_op::DOUBLE;
+            case static_cast<int32_t>(postgres_types::TEXT):
+            case static_cast<int32_t>(postgres_types::CHAR):
+            case static_cast<int32_t>(postgres_types::VARCHAR):
+                document_type = document_types::STRING;
+                return tsl::column_op::STRING;
+            case static_cast<int32_t>(postgres_types::UUID):
+                document_type = document_types::BINARY;
+                return tsl::column_op::UUID;
+            case static_cast<int32_t>(postgres_types::BYTEA):
+                document_type = document_types::BINARY;
+                return tsl::column_op::BYTES;
+            case static_cast<int32_t>(postgres_types::DATE):
+                document_type = document_types::INT32;
+                return tsl::column_op::DATE;
+            case static_cast<int32_t>(postgres_types::TIME):
+                document_type = document_types::INT64;
+                return tsl::column_op::TIME;
+            case static_cast<int32_t>(postgres_types::TIMESTAMP):
+            case static_cast<int32_t>(postgres_types::TIMESTAMPTZ):
+                document_type = document_types::INT64;
+                return tsl::column_op::TIMESTAMP;
+            case static_cast<int32_t>(postgres_types::JSON):
+                document_type = document_types::DICT;
+                return tsl::column_op::JSON;
+            case static_cast<int32_t>(postgres_types::JSONB):
+                document_type = document_types::DICT;
+                return tsl::column_op::JSONB;
             default:
-            {
-                std::stringstream oss;
-                oss << "Cant find row to doc array translator for type: " << type;
-                std::cerr << oss.str() << std::endl;
-                throw std::runtime_error(oss.str());
-            }
+                document_type = document_types::INVALID;
+                return tsl::column_op::UNSUPPORTED;
         }
-
     }
 
-    void
-    set_array(components::document::document_ptr doc,
-               const std::string &name,
-               const std::vector<std::string> &result,
-               const int16_t &index,
-               const int32_t& type) {
-        if (result[index] == emptyValue) {
-            doc->set(name, nullptr);
-            return;
+    /// Element type OID of an array type OID, 0 when type is not a supported array.
+    int32_t array_element_type(int32_t type) {
+        switch (type) {
+            case static_cast<int32_t>(postgres_array_types::BOOL): return static_cast<int32_t>(postgres_types::BOOL);
+            case static_cast<int32_t>(postgres_array_types::BIT): return static_cast<int32_t>(postgres_types::BIT);
+            case static_cast<int32_t>(postgres_array_types::CHAR): return static_cast<int32_t>(postgres_types::CHAR);
+            case static_cast<int32_t>(postgres_array_types::INT2): return static_cast<int32_t>(postgres_types::INT2);
+            case static_cast<int32_t>(postgres_array_types::INT4): return static_cast<int32_t>(postgres_types::INT4);
+            case static_cast<int32_t>(postgres_array_types::INT8): return static_cast<int32_t>(postgres_types::INT8);
+            case static_cast<int32_t>(postgres_array_types::TEXT): return static_cast<int32_t>(postgres_types::TEXT);
+            case static_cast<int32_t>(postgres_array_types::VARCHAR): return static_cast<int32_t>(postgres_types::VARCHAR);
+            case static_cast<int32_t>(postgres_array_types::FLOAT): return static_cast<int32_t>(postgres_types::FLOAT);
+            case static_cast<int32_t>(postgres_array_types::DOUBLE): return static_cast<int32_t>(postgres_types::DOUBLE);
+            case static_cast<int32_t>(postgres_array_types::NUMERIC): return static_cast<int32_t>(postgres_types::NUMERIC);
+            case static_cast<int32_t>(postgres_array_types::UUID): return static_cast<int32_t>(postgres_types::UUID);
+            case static_cast<int32_t>(postgres_array_types::BYTEA): return static_cast<int32_t>(postgres_types::BYTEA);
+            case static_cast<int32_t>(postgres_array_types::DATE): return static_cast<int32_t>(postgres_types::DATE);
+            case static_cast<int32_t>(postgres_array_types::TIME): return static_cast<int32_t>(postgres_types::TIME);
+            case static_cast<int32_t>(postgres_array_types::TIMESTAMP): return static_cast<int32_t>(postgres_types::TIMESTAMP);
+            case static_cast<int32_t>(postgres_array_types::TIMESTAMPTZ): return static_cast<int32_t>(postgres_types::TIMESTAMPTZ);
+            case static_cast<int32_t>(postgres_array_types::JSON): return static_cast<int32_t>(postgres_types::JSON);
+            case static_cast<int32_t>(postgres_array_types::JSONB): return static_cast<int32_t>(postgres_types::JSONB);
+            default: return 0;
         }
+    }
 
-        std::vector<std::string> values = parse_string(result[index]);
-        doc->set_array(name);
-        auto translator = type_to_translator_array(type);
+    /// Writes a json value into nested documents as the json reader finds it, objects as dicts and arrays as arrays.
+    /// The top level value is written at name in doc, so a json scalar is a plain value there.
+    class json_writer {
+    public:
+        json_writer(const components::document::document_ptr &doc_, const std::string &name_)
+            : doc(doc_),
+              name(name_) {
+        }
 
-        for (int i = 0; i < values.size(); i++) {
-            translator(doc->get_array(name), std::to_string(i), std::vector{values[i]}, 0);
+        void begin_object() {
+            const components::document::document_ptr &parent = next_parent();
+            parent->set_dict(current_key);
+            levels.push_back({parent->get_dict(current_key), false});
         }
-    }
 
-    void
-    set_int8_postgres(components::document::document_ptr doc,
-                      const std::string &name,
-                      const pqxx::row &result,
-                      const int16_t &index) {
-        if (result[index].is_null()) {
-            doc->set(name, nullptr);
-            return;
+        void end_object() {
+            levels.pop_back();
         }
-        int64_t int_value = result[index].get<int64_t>().value();
-        doc->set<int8_t>(name, int_value);
-    }
 
-    void
-    set_int16_postgres(components::document::document_ptr doc,
-                       const std::string &name,
-                       const pqxx::row &result,
-                       const int16_t &index) {
-        if (result[index].is_null()) {
-            doc->set(name, nullptr);
-            return;
+        void begin_array() {
+            const components::document::document_ptr &parent = next_parent();
+            parent->set_array(current_key);
+            levels.push_back({parent->get_array(current_key), true});
         }
-        int64_t int_value = result[index].get<int64_t>().value();
-        doc->set<int16_t>(name, int_value);
-    }
 
-    void
-    set_int32_postgres(components::document::document_ptr doc,
-                       const std::string &name,
-                       const pqxx::row &result,
-                       const int16_t &index) {
-        if (result[index].is_null()) {
-            doc->set(name, nullptr);
-            return;
+        void end_array() {
+            levels.pop_back();
         }
-        int64_t int_value = result[index].get<int64_t>().value();
-        doc->set<int32_t>(name, int_value);
-    }
 
-    void
-    set_int64_postgres(components::document::document_ptr doc,
-                       const std::string &name,
-                       const pqxx::row &result,
-                       const int16_t &index) {
-        if (result[index].is_null()) {
-            doc->set(name, nullptr);
-            return;
+        void key(std::string_view member) {
+            current_key.assign(member);
         }
-        int64_t int_value = result[index].get<int64_t>().value();
-        doc->set<int64_t>(name, int_value);
-    }
 
-    void
-    set_float_postgres(components::document::document_ptr doc,
-                       const std::string &name,
-                       const pqxx::row &result,
-                       const int16_t &index)
-    {
-        if (result[index].is_null()) {
-            doc->set(name, nullptr);
-            return;
+        void string(std::string_view value) {
+            next_parent()->set<std::string>(current_key, std::string(value));
         }
-        float float_value = result[index].get<float>().value();
-        doc->set<float>(name, float_value);
-    }
 
-    void
-    set_double_postgres(components::document::document_ptr doc,
-                        const std::string &name,
-                        const pqxx::row &result,
-                        const int16_t &index) {
-        if (result[index].is_null()) {
-            doc->set(name, nullptr);
-            return;
+        /// int64 when the number is integral and fits, double otherwise.
+        void number(std::string_view text) {
+            const components::document::document_ptr &parent = next_parent();
+            int64_t integer;
+            const char *end = text.data() + text.size();
+            auto [stop, error] = std::from_chars(text.data(), end, integer);
+            if (error == std::errc{} && stop == end) {
+                parent->set<int64_t>(current_key, integer);
+            } else {
+                parent->set<double>(current_key, parse_number<double>(text));
+            }
         }
-        double double_value = result[index].get<double>().value();
-        doc->set<double>(name, double_value);
-    }
 
-    void
-    set_bit_postgres(components::document::document_ptr doc,
-                     const std::string &name,
-                     const pqxx::row &result,
-                     const int16_t &index) {
-        if (result[index].is_null()) {
-            doc->set(name, nullptr);
-            return;
+        void boolean(bool value) {
+            next_parent()->set<bool>(current_key, value);
         }
-        bool bool_value = result[index].get<bool>().value();
-        doc->set<bool>(name, false);
-    }
 
-    void
-    set_string_postgres(components::document::document_ptr doc,
-                        const std::string &name,
-                        const pqxx::row &result,
-                        const int16_t &index) {
-        if (result[index].is_null()) {
-            doc->set(name, nullptr);
-            return;
+        void null() {
+            next_parent()->set(current_key, nullptr);
         }
-        std::string string_value = result[index].c_str();
-        doc->set<std::string>(name, string_value);
-    }
 
-    void
-    set_array_postgres(components::document::document_ptr doc,
-                       const std::string &name,
-                       const pqxx::row &result,
-                       const int16_t &index,
-                       const int32_t &type) {
-        if (result[index].is_null()) {
-            doc->set(name, nullptr);
-            return;
+    private:
+        /// Container of the next value, current_key is set to its key there.
+        const components::document::document_ptr &next_parent() {
+            if (levels.empty()) {
+                current_key = name;
+                return doc;
+            }
+            level &top = levels.back();
+            if (top.is_array) {
+                current_key = std::to_string(top.size++);
+            }
+            return top.document;
         }
 
-        std::string string_value = result[index].c_str();
-        std::vector<std::string> values = parse_string(string_value);
-        doc->set_array(name);
-        auto translator = type_to_translator_array(type);
+        struct level {
+            components::document::document_ptr document;
+            bool is_array = false;
+            size_t size = 0;
+        };
+
+        const components::document::document_ptr &doc;
+        const std::string &name;
+        std::vector<level> levels;
+        std::string current_key;
+    };
 
-        for (int i = 0; i < values.size(); i++) {
-            translator(doc->get_array(name), std::to_string(i), std::vector{values[i]}, 0);
+    void set_json(const components::document::document_ptr &doc,
+                  const std::string &name,
+                  tsl::column_op op,
+                  const replication_value &value) {
+        std::string_view text = value.data;
+        if (op == tsl::column_op::JSONB && value.is_binary()) {
+            if (text.empty() || text[0] != postgres::json::jsonb_version) {
+                throw exception(error_codes::INVALID_INPUT, "Unsupported binary jsonb version");
+            }
+            text.remove_prefix(1);
         }
+        json_writer writer(doc, name);
+        std::string buffer;
+        postgres::json::parse(text, writer, buffer);
     }
 
-    struct logical_replication_to_doc_setter {
-        document_types type;
-        logical_replication_to_otterbrix_doc_impl setter;
-    };
+    /// Writes a value that is not null; op is never ARRAY here.
+    void set_scalar(const components::document::document_ptr &doc,
+                    const std::string &name,
+                    tsl::column_op op,
+                    const tsl::column_decoder &column,
+                    const replication_value &value) {
+        switch (op) {
+            case tsl::column_op::INT16:
+                doc->set<int16_t>(name, read_integer(value));
+                return;
+            case tsl::column_op::INT32:
+                doc->set<int32_t>(name, read_integer(value));
+                return;
+            case tsl::column_op::INT64:
+                doc->set<int64_t>(name, read_integer(value));
+                return;
+            case tsl::column_op::DECIMAL:
+                doc->set<absl::int128>(name, read_decimal(value, column.scale));
+                return;
+            case tsl::column_op::NUMERIC:
+                doc->set<std::string>(name, read_numeric(value));
+                return;
+            case tsl::column_op::FLOAT:
+                doc->set<float>(name, read_float(value));
+                return;
+            case tsl::column_op::DOUBLE:
+                doc->set<double>(name, read_double(value));
+                return;
+            case tsl::column_op::BOOL:
+                doc->set<bool>(name, read_bool(value));
+                return;
+            case tsl::column_op::STRING:
+                doc->set<std::string>(name, std::string(value.data));
+                return;
+            case tsl::column_op::UUID:
+                doc->set<std::string>(name, read_uuid(value));
+                return;
+            case tsl::column_op::BYTES:
+                doc->set<std::string>(name, read_bytes(value));
+                return;
+            case tsl::column_op::DATE:
+                doc->set<int32_t>(name, read_date(value));
+                return;
+            case tsl::column_op::TIME:
+                doc->set<int64_t>(name, read_time(value));
+                return;
+            case tsl::column_op::TIMESTAMP:
+                doc->set<int64_t>(name, read_timestamp(value));
+                return;
+            case tsl::column_op::JSON:
+            case tsl::column_op::JSONB:
+                set_json(doc, name, op, value);
+                return;
+            case tsl::column_op::ARRAY:
+            case tsl::column_op::UNSUPPORTED:
+                break;
+        }
+        throw exception(error_codes::INVALID_INPUT,
+                        fmt::format("Cant find row to doc translator for type: {}, column: {}", column.type, name));
+    }
 
-    struct postgres_to_doc_setter {
-        document_types type;
-        postgres_to_otterbrix_doc_impl setter;
-    };
+    /// Writes the elements of an array value into nested document arrays as the array reader finds them.
+    class array_writer {
+    public:
+        array_writer(const components::document::document_ptr &doc_, const tsl::column_decoder &column_, char kind_)
+            : doc(doc_),
+              column(column_),
+              kind(kind_) {
+        }
 
-    logical_replication_to_doc_setter logical_replication_to_doc(const int32_t& type) {
-        postgres_types postgres_types = get_enum(type);
-        switch (postgres_types) {
-            case postgres_types::INT2:
-            case postgres_types::INT4:
-            case postgres_types::INT8:
-            {
-                return {document_types::INT8, set_int8};
-            }
-            case postgres_types::NUMERIC:
-            {
-                return {document_types::INT64, set_int64};
-            }
-            case postgres_types::BIT:
-            {
-                return {document_types::BOOL, set_bit};
+        void begin_array() {
+            if (depth == 0) {
+                doc->set_array(column.name);
+                levels[depth++] = {doc->get_array(column.name), 0};
+                return;
             }
-            case postgres_types::FLOAT:
-            {
-                return {document_types::FLOAT, set_float};
+            const std::string key = next_key();
+            const components::document::document_ptr &parent = levels[depth - 1].array;
+            parent->set_array(key);
+            levels[depth++] = {parent->get_array(key), 0};
+        }
+
+        void end_array() {
+            levels[--depth].array = nullptr;
+        }
+
+        void element(std::string_view data, bool is_null) {
+            const std::string key = next_key();
+            const components::document::document_ptr &array = levels[depth - 1].array;
+            if (is_null) {
+                array->set(key, nullptr);
+            } else {
+                set_scalar(array, key, column.element_op, column, replication_value{data, kind});
             }
-            case postgres_types::DOUBLE:
-            {
-                return {document_types::DOUBLE, set_double};
+        }
+
+    private:
+        std::string next_key() {
+            return std::to_string(levels[depth - 1].size++);
+        }
+
+        struct level {
+            components::document::document_ptr array;
+            size_t size = 0;
+        };
+
+        const components::document::document_ptr &doc;
+        const tsl::column_decoder &column;
+        const char kind;
+        level levels[postgres::array::max_dimensions];
+        size_t depth = 0;
+    };
+
+    void set_array(const components::document::document_ptr &doc,
+                   const tsl::column_decoder &column,
+                   const replication_value &value) {
+        array_writer writer(doc, column, value.kind);
+        if (value.is_binary()) {
+            postgres::array::parse_binary(value.data, writer);
+            return;
+        }
+        std::string buffer;
+        postgres::array::parse_text(value.data, writer, buffer);
+    }
+} // namespace
+
+namespace tsl {
+    row_decoder make_row_decoder(const std::vector<std::pair<std::string, int32_t>> &columns,
+                                 const std::vector<int32_t> &type_modifiers) {
+        row_decoder decoder;
+        decoder.columns.reserve(columns.size());
+        decoder.schema.reserve(columns.size());
+
+        for (size_t index = 0; index < columns.size(); ++index) {
+            const auto &[name, type] = columns[index];
+            column_decoder column;
+            column.type = type;
+            column.name = name;
+
+            document_types document_type;
+            column.op = scalar_op(type, document_type);
+            column_op *numeric_op = column.op == column_op::NUMERIC ? &column.op : nullptr;
+            if (column.op == column_op::UNSUPPORTED) {
+                if (int32_t element_type = array_element_type(type)) {
+                    column.op = column_op::ARRAY;
+                    column.element_op = scalar_op(element_type, document_type);
+                    document_type = document_types::ARRAY;
+                    numeric_op = column.element_op == column_op::NUMERIC ? &column.element_op : nullptr;
+                }
             }
-            case postgres_types::TEXT:
-            case postgres_types::CHAR:
-            case postgres_types::VARCHAR:
-            case postgres_types::UUID:
-            {
-                return {document_types::STRING, set_string};
+
+            // The typmod of a numeric array is the typmod of its elements
+            if (numeric_op && index < type_modifiers.size()) {
+                const postgres::numeric::type_modifier modifier = postgres::numeric::read_type_modifier(type_modifiers[index]);
+                if (modifier.is_fixed()) {
+                    *numeric_op = column_op::DECIMAL;
+                    column.precision = modifier.precision;
+                    column.scale = modifier.scale;
+                    if (column.op == column_op::DECIMAL) {
+                        document_type = document_types::DECIMAL;
+                    }
+                }
             }
-            case postgres_types::ARRAY: {
-                auto setter = [type_element = type](components::document::document_ptr doc,
-                                                    const std::string &name,
-                                                    const std::vector<std::string> &result,
-                                                    const int16_t &index) ->
-                    void { set_array(doc, name, result, index, type_element); };
-                logical_replication_to_doc_setter row_to_doc_setter;
-                row_to_doc_setter.setter = std::move(setter);
-                row_to_doc_setter.type = document_types::ARRAY;
-                return row_to_doc_setter;
+
+            decoder.schema.push_back({document_type, name, column.precision, column.scale});
+            decoder.columns.push_back(std::move(column));
+        }
+        return decoder;
+    }
+
+    components::document::document_ptr logical_replication_to_doc(std::pmr::memory_resource *res,
+                                                                  const row_decoder &decoder,
+                                                                  const replication_row &row) {
+        components::document::document_ptr doc = components::document::make_document(res);
+        for (size_t index = 0; index < decoder.size(); ++index) {
+            const column_decoder &column = decoder[index];
+            if (index >= row.size()) {
+                doc->set(column.name, nullptr);
+                continue;
             }
-            default:
-            {
-                std::stringstream oss;
-                oss << "Cant find row to doc translator for type: " << type;
-                std::cerr << oss.str() << std::endl;
-                throw std::runtime_error(oss.str());
+
+            const replication_value value = row[index];
+            if (value.is_null()) {
+                doc->set(column.name, nullptr);
+            } else if (column.op == column_op::ARRAY) {
+                set_array(doc, column, value);
+            } else {
+                set_scalar(doc, column.name, column.op, column, value);
             }
         }
+        return doc;
     }
 
-    postgres_to_doc_setter postgres_to_doc(const int32_t& type) {
-        postgres_types postgres_types = get_enum(type);
-        switch (postgres_types) {
+    std::string value_to_string(const replication_value &value, int32_t type) {
+        if (!value.is_binary()) {
+            return std::string(value.data);
+        }
+
+        switch (get_enum(type)) {
             case postgres_types::INT2:
             case postgres_types::INT4:
             case postgres_types::INT8:
-            {
-                return {document_types::INT8, set_int8_postgres};
-            }
+                return std::to_string(postgres::binary::read_integer(value.data));
             case postgres_types::NUMERIC:
-            {
-                return {document_types::INT64, set_int64_postgres};
-            }
-            case postgres_types::BIT:
-            {
-                return {document_types::BOOL, set_bit_postgres};
-            }
+                return postgres::numeric::binary_to_string(value.data);
             case postgres_types::FLOAT:
-            {
-                return {document_types::FLOAT, set_float_postgres};
-            }
+                return fmt::format("{}", postgres::binary::read_float4(value.data));
             case postgres_types::DOUBLE:
-            {
-                return {document_types::DOUBLE, set_double_postgres};
-            }
-            case postgres_types::TEXT:
-            case postgres_types::CHAR:
-            case postgres_types::VARCHAR:
+                return fmt::format("{}", postgres::binary::read_float8(value.data));
+            case postgres_types::BOOL:
+            case postgres_types::BIT:
+                return postgres::binary::read_bool(value.data) ? "true" : "false";
             case postgres_types::UUID:
-            {
-                return {document_types::STRING, set_string_postgres};
-            }
-            case postgres_types::ARRAY: {
-                auto setter = [type_element = type](components::document::document_ptr doc,
-                                                    const std::string &name,
-                                                    const pqxx::row &result,
-                                                    const int16_t &index) ->
-                    void { set_array_postgres(doc, name, result, index, type_element); };
-                postgres_to_doc_setter row_to_doc_setter;
-                row_to_doc_setter.setter = std::move(setter);
-                row_to_doc_setter.type = document_types::ARRAY;
-                return row_to_doc_setter;
-            }
+                return postgres::binary::read_uuid(value.data);
+            case postgres_types::BYTEA:
+                return "\\x" + postgres::binary::to_hex(value.data);
+            case postgres_types::JSONB:
+                return std::string(value.data.substr(!value.data.empty() && value.data[0] == postgres::json::jsonb_version));
+            case postgres_types::DATE:
+                return std::to_string(postgres::datetime::read_date(value.data));
+            case postgres_types::TIME:
+                return std::to_string(postgres::datetime::read_time(value.data));
+            case postgres_types::TIMESTAMP:
+            case postgres_types::TIMESTAMPTZ:
+                return std::to_string(postgres::datetime::read_timestamp(value.data));
             default:
-            {
-                std::stringstream oss;
-                oss << "Cant find row to doc translator for type: " << type;
-                std::cerr << oss.str() << std::endl;
-                throw std::runtime_error(oss.str());
-            }
+                return std::string(value.data);
         }
     }
-} // namespace
 
-namespace tsl {
-    docs_result postgres_to_docs(std::pmr::memory_resource *res, const pqxx::result &result) {
-        const auto ncolumns = result.columns();
-        const auto nrows = result.size();
-
-        std::vector<postgres_to_otterbrix_doc> postgres_row_to_doc_translators;
-        postgres_row_to_doc_translators.reserve(ncolumns);
-        std::vector<column_info> schema;
-        schema.reserve(ncolumns);
-
-        size_t counter = 0;
-        for (const auto &column: result[0]) {
-            auto translator = postgres_to_doc(column.type());
-            schema.emplace_back(translator.type, column.name());
-
-            auto wrapper = [translator = translator.setter, index = counter++, name = column.name()](
-                components::document::document_ptr doc,
-                const pqxx::row &row) -> void {
-                translator(doc, name, row, index);
-            };
-            postgres_row_to_doc_translators.push_back(std::move(wrapper));
-        }
-
-        assert(postgres_row_to_doc_translators.size() == ncolumns);
-        if (postgres_row_to_doc_translators.size() != ncolumns) {
-            std::stringstream oss;
-            oss << "Invalid number of translators: " << postgres_row_to_doc_translators.size() << " expected: " <<
-                    ncolumns;
-            std::cerr << oss.str() << std::endl;
-            throw std::runtime_error(oss.str());
-        }
-
-        std::vector<components::document::document_ptr> docs;
-        docs.reserve(nrows);
-
-        for (const auto &row: result) {
-             components::document::document_ptr doc =  components::document::make_document(res);
-            for (const auto &translator: postgres_row_to_doc_translators) {
-                translator(doc, row);
-            }
-            docs.push_back(std::move(doc));
-        }
-
-        return {std::move(schema), std::move(docs)};
-    }
-
-    doc_result logical_replication_to_docs(std::pmr::memory_resource *res, int16_t num_columns,
-                                           const std::vector<std::pair<std::string, int32_t> > &columns,
-                                           const std::vector<std::string> &result) {
-        std::vector<logical_replication_to_otterbrix_doc> postgres_row_to_doc_translators;
-        postgres_row_to_doc_translators.reserve(num_columns);
-        std::vector<column_info> schema;
-        schema.reserve(num_columns);
-
-        for (int16_t i = 0; i < num_columns; i++) {
-
-            auto translator = logical_replication_to_doc(columns[i].second);
-            schema.emplace_back(translator.type, columns[i].first);
-
-            auto wrapper = [translator = translator.setter, index = i, name = columns[i].first](
-                               components::document::document_ptr doc,
-                               const std::vector<std::string> &result) -> void { translator(doc, name, result, index); };
-            postgres_row_to_doc_translators.push_back(std::move(wrapper));
-        }
-
-        assert(postgres_row_to_doc_translators.size() == num_columns);
-        if (postgres_row_to_doc_translators.size() != num_columns) {
-            std::stringstream oss;
-            oss << "Invalid number of translator: " << postgres_row_to_doc_translators.size() << " expected: " << num_columns;
-            std::cerr << oss.str() << std::endl;
-            throw std::runtime_error(oss.str());
-        }
-
-        components::document::document_ptr doc =  components::document::make_document(res);
-        for (const auto &translator: postgres_row_to_doc_translators) {
-            translator(doc, result);
+    void add_key_parameter(const components::logical_plan::parameter_node_ptr &params,
+                           core::parameter_id_t id,
+                           const replication_value &value,
+                           const column_decoder &column) {
+        switch (column.op) {
+            case column_op::INT16:
+                params->add_parameter(id, static_cast<int16_t>(read_integer(value)));
+                return;
+            case column_op::INT32:
+                params->add_parameter(id, static_cast<int32_t>(read_integer(value)));
+                return;
+            case column_op::INT64:
+                params->add_parameter(id, read_integer(value));
+                return;
+            case column_op::DECIMAL:
+                params->add_parameter(id, read_decimal(value, column.scale));
+                return;
+            case column_op::FLOAT:
+                params->add_parameter(id, read_float(value));
+                return;
+            case column_op::DOUBLE:
+                params->add_parameter(id, read_double(value));
+                return;
+            case column_op::BOOL:
+                params->add_parameter(id, read_bool(value));
+                return;
+            case column_op::UUID:
+                params->add_parameter(id, read_uuid(value));
+                return;
+            case column_op::BYTES:
+                params->add_parameter(id, read_bytes(value));
+                return;
+            case column_op::DATE:
+                params->add_parameter(id, read_date(value));
+                return;
+            case column_op::TIME:
+                params->add_parameter(id, read_time(value));
+                return;
+            case column_op::TIMESTAMP:
+                params->add_parameter(id, read_timestamp(value));
+                return;
+            default:
+                params->add_parameter(id, value_to_string(value, column.type));
+                return;
         }
-
-        return {std::move(schema), std::move(doc)};
     }
 
     std::optional<std::vector<column_info>> merge_schemas(const std::vector<std::vector<column_info>>& schemas) {
@@ -1,13 +1,20 @@
+#include <algorithm>
 #include <string>
 #include <iostream>
+#include <limits>
 #include <memory>
+#include <mutex>
 #include <filesystem>
+#include <unordered_map>
+#include <fmt/format.h>
 
 #include <spdlog/sinks/stdout_color_sinks.h>
 #include <actor-zeta/base/address.hpp>
 
 #include <otterbrix/otterbrix_service.h>
 #include <otterbrix/otterbrix_converter.h>
+#include <common/batch_arena.h>
+#include <common/exception.h>
 
 #include <components/expressions/compare_expression.hpp>
 #include <components/logical_plan/node.hpp>
@@ -27,191 +34,482 @@ using expressions::compare_type;
 using key = expressions::key_t;
 using id_par = core::parameter_id_t;
 
+namespace {
+    /// Parameter ids are 16 bit, a delete batch is written before it runs out of them.
+    constexpr size_t max_batch_parameters = std::numeric_limits<unsigned short>::max() - 1;
+
+    /// Match templates kept per table. A table with a primary key needs one; without one, or for an old row,
+    /// every null pattern of the row is a key of its own and the least recently used one is rebuilt when needed.
+    constexpr size_t max_match_templates = 16;
+
+    using wal_manager_ptr = decltype(actor_zeta::spawn_supervisor<services::wal::manager_wal_replicate_t>(
+        std::declval<std::pmr::memory_resource *>(), nullptr, otterbrix::config_wal(), std::declval<log_t &>()));
+}
+
+struct otterbrix_service::table_batch {
+    std::string database_name;
+    std::string table_name;
+    postgre_sql_type_operation type_operation = postgre_sql_type_operation::NOT_PROCESSED;
+    std::pmr::vector<document_ptr> documents;
+    std::vector<row_key> keys;
+    logical_plan::parameter_node_ptr params;
+    size_t parameters = 0;
+};
+
+struct otterbrix_service::match_template {
+    std::vector<int32_t> key_columns;
+    std::vector<std::string> key_names;
+    expressions::expression_ptr expression;
+};
+
+namespace {
+    /// The WAL writer of the process. otterbrix replays one WAL directory in file order, so every service writes
+    /// through it: the consumer and its apply workers, every shard and every snapshot worker. A writer per service
+    /// would append to the same files without coordination, and a directory per writer would never be replayed.
+    struct wal_writer {
+        wal_writer()
+            : underlying_logger(std::make_shared<spdlog::logger>(
+                  "otterbrix_apply", std::make_shared<spdlog::sinks::stdout_color_sink_mt>())),
+              my_logger(underlying_logger),
+              manager_addr(actor_zeta::base::address_t::empty_address()),
+              wrapper_dispatcher(&resource, manager_addr, my_logger),
+              path(core::filesystem::path_t::path()),
+              file_handle(std::make_unique<core::filesystem::file_handle_t>(local_file_system, path)),
+              manager(actor_zeta::spawn_supervisor<services::wal::manager_wal_replicate_t>(wrapper_dispatcher.resource(),
+                                                                                           nullptr,
+                                                                                           otterbrix::config_wal(),
+                                                                                           my_logger)),
+              wal(manager.get(), my_logger, file_handle) {
+        }
+
+        // Members are destroyed in reverse order: the writer before the manager, the dispatcher before the resource
+        std::pmr::synchronized_pool_resource resource;
+        std::shared_ptr<spdlog::logger> underlying_logger;
+        log_t my_logger;
+        actor_zeta::base::address_t manager_addr;
+        otterbrix::wrapper_dispatcher_t wrapper_dispatcher;
+        core::filesystem::local_file_system_t local_file_system;
+        core::filesystem::path_t path;
+        std::unique_ptr<core::filesystem::file_handle_t> file_handle;
+        wal_manager_ptr manager;
+        services::wal::wal_replicate_t wal;
+
+        /// Held for every record, records of different services do not interleave.
+        std::mutex write_mutex;
+    };
+
+    /// Created by the first service and kept while any service is alive.
+    std::shared_ptr<wal_writer> get_wal_writer() {
+        static std::mutex writer_mutex;
+        static std::weak_ptr<wal_writer> shared_writer;
+
+        std::lock_guard guard(writer_mutex);
+        std::shared_ptr<wal_writer> writer = shared_writer.lock();
+        if (!writer) {
+            writer = std::make_shared<wal_writer>();
+            shared_writer = writer;
+        }
+        return writer;
+    }
+}
+
+struct otterbrix_service::apply_context {
+    std::shared_ptr<wal_writer> writer = get_wal_writer();
+
+    // Members are destroyed in reverse order: the arena before the resource
+    std::pmr::synchronized_pool_resource resource;
+
+    /// Documents, expressions and plan nodes of the current batch, released by flush().
+    batch_arena arena;
+
+    std::unordered_map<std::string, table_batch> batches;
+    size_t pending = 0;
+
+    std::unordered_map<std::string, std::vector<match_template>> match_templates;
+    std::vector<int32_t> key_columns;
+};
+
+otterbrix_service::otterbrix_service() = default;
+
+otterbrix_service::otterbrix_service(otterbrix_service &&) noexcept = default;
+
+otterbrix_service::~otterbrix_service() {
+    shutdown();
+}
+
+void otterbrix_service::shutdown() {
+    if (context && context->pending != 0) {
+        flush();
+    }
+    context.reset();
+}
+
+otterbrix_service::apply_context & otterbrix_service::get_context() {
+    if (!context) {
+        context = std::make_unique<apply_context>();
+    }
+    return *context;
+}
+
 void otterbrix_service::data_handler(postgre_sql_type_operation type_operation,
                                     const std::string &table_name,
                                     const std::string &database_name,
                                     const std::vector<int32_t> &primary_key,
-                                    const std::vector<std::string> &result,
-                                    const std::vector<std::pair<std::string, int32_t>> &columns,
-                                    const std::unordered_map<int32_t, std::string> &old_value) {
-    auto resource = std::pmr::synchronized_pool_resource();
-    underlying_logger = spdlog::stdout_color_mt("app_logger");
-    log_t my_logger(underlying_logger);
-    actor_zeta::base::address_t manager_addr = actor_zeta::base::address_t::empty_address();
-    otterbrix::wrapper_dispatcher_t wrapper_dispatcher(&resource, manager_addr, my_logger);
-    core::filesystem::local_file_system_t local_file_system = core::filesystem::local_file_system_t();
-    core::filesystem::path_t path = core::filesystem::path_t::path();
-    std::unique_ptr<core::filesystem::file_handle_t> file_ptr1 =
-        std::make_unique<core::filesystem::file_handle_t>(local_file_system, path);
-    auto wal_conf = otterbrix::config_wal();
-    auto manager = actor_zeta::spawn_supervisor<services::wal::manager_wal_replicate_t>(wrapper_dispatcher.resource(),
-                                                                                            nullptr,
-                                                                                            wal_conf,
-                                                                                            my_logger);
-    services::wal::wal_replicate_t wal(manager.get(), log, file_ptr1);
+                                    const replication_row &result,
+                                    const tsl::row_decoder &decoder,
+                                    const replication_row &old_value) {
+    if (type_operation == postgre_sql_type_operation::NOT_PROCESSED) {
+        return;
+    }
+
+    apply_context & apply = get_context();
+    auto & resource = apply.arena;
+    wal_writer & writer = *apply.writer;
+    otterbrix::session_id_t session_id;
     switch (type_operation) {
         case postgre_sql_type_operation::INSERT: {
-            tsl::doc_result doc_result = tsl::logical_replication_to_docs(&resource, columns.size(), columns, result);
-            auto insert_node = logical_plan::make_node_insert(std::pmr::get_default_resource(),
+            document_ptr document = tsl::logical_replication_to_doc(&resource, decoder, result);
+            auto insert_node = logical_plan::make_node_insert(&resource,
                                                               {database_name, table_name},
-                                                              doc_result.document);
-            otterbrix::session_id_t session_id;
-            wal.insert_one(session_id, manager_addr, insert_node);
+                                                              document);
+            std::lock_guard guard(writer.write_mutex);
+            writer.wal.insert_one(session_id, writer.manager_addr, insert_node);
             break;
         }
-        case postgre_sql_type_operation::UPDATE: {
-            tsl::doc_result doc_result = tsl::logical_replication_to_docs(&resource, columns.size(), columns, result);
-            std::pair<expressions::expression_ptr, logical_plan::parameter_node_ptr> expression;
-            if (!old_value.empty()) {
-                expression = make_expression_match(&resource, old_value, columns);
-            } else {
-                expression = make_expression_match(&resource, primary_key, result, columns);
-            }
-
-            auto node_match = logical_plan::make_node_match(&resource,
-                                                            {database_name, table_name},
-                                                            std::move(expression.first));
-            auto node_update = logical_plan::make_node_update_one(&resource,
-                                                                  {database_name, table_name},
-                                                                  node_match,
-                                                                  doc_result.document);
-            otterbrix::session_id_t session_id;
-            wal.update_one(session_id, manager_addr, node_update, expression.second);
+        case postgre_sql_type_operation::UPDATE:
+            write_update(table_name, database_name, primary_key, result, decoder, old_value, false);
             break;
-        }
         case postgre_sql_type_operation::DELETE: {
             std::pair<expressions::expression_ptr, logical_plan::parameter_node_ptr> expression
-                = make_expression_match(&resource, primary_key, result, columns);
+                = make_expression_match(&resource, database_name, table_name, primary_key, result, decoder);
             auto node_match = logical_plan::make_node_match(&resource,
                                                             {database_name, table_name},
                                                             std::move(expression.first));
             auto node_delete = logical_plan::make_node_delete_one(&resource,
                                                               {database_name, table_name},
                                                               node_match);
-            otterbrix::session_id_t session_id;
-            wal.delete_one(session_id, manager_addr, node_delete, expression.second);
+            std::lock_guard guard(writer.write_mutex);
+            writer.wal.delete_one(session_id, writer.manager_addr, node_delete, expression.second);
             break;
         }
+        case postgre_sql_type_operation::NOT_PROCESSED:
+            break;
     }
 }
 
-void otterbrix_service::data_handler(pqxx::result &result,
-                                     const std::string &table_name,
-                                     const std::string &database_name) {
-    auto resource = std::pmr::synchronized_pool_resource();
-    tsl::docs_result docs_result = tsl::postgres_to_docs(&resource, result);
+void otterbrix_service::write_update(const std::string &table_name,
+                                     const std::string &database_name,
+                                     const std::vector<int32_t> &primary_key,
+                                     const replication_row &result,
+                                     const tsl::row_decoder &decoder,
+                                     const replication_row &old_value,
+                                     bool upsert) {
+    apply_context & apply = get_context();
+    auto & resource = apply.arena;
+    otterbrix::session_id_t session_id;
 
-    for (auto doc: docs_result.document) {
-        auto insert_node = logical_plan::make_node_insert(std::pmr::get_default_resource(),
+    document_ptr document = tsl::logical_replication_to_doc(&resource, decoder, result);
+    // 'K' holds only the key columns and 'O' the whole old row, both are matched by their non-null columns
+    std::pair<expressions::expression_ptr, logical_plan::parameter_node_ptr> expression
+        = old_value.empty()
+          ? make_expression_match(&resource, database_name, table_name, primary_key, result, decoder)
+          : make_expression_match(&resource, database_name, table_name, {}, old_value, decoder);
+
+    auto node_match = logical_plan::make_node_match(&resource,
+                                                    {database_name, table_name},
+                                                    std::move(expression.first));
+    auto node_update = logical_plan::make_node_update_one(&resource,
                                                           {database_name, table_name},
-                                                          doc);
+                                                          node_match,
+                                                          document,
+                                                          upsert);
+    std::lock_guard guard(apply.writer->write_mutex);
+    apply.writer->wal.update_one(session_id, apply.writer->manager_addr, node_update, expression.second);
+}
+
+otterbrix_service::table_batch & otterbrix_service::get_batch(const std::string &database_name,
+                                                              const std::string &table_name) {
+    apply_context & apply = get_context();
+    auto [it, inserted] = apply.batches.try_emplace(database_name + '.' + table_name);
+    table_batch & batch = it->second;
+    if (inserted) {
+        batch.database_name = database_name;
+        batch.table_name = table_name;
+        batch.documents = std::pmr::vector<document_ptr>(&apply.resource);
     }
+    return batch;
 }
 
-std::pair<expressions::expression_ptr, logical_plan::parameter_node_ptr> otterbrix_service::make_expression_match(
-    std::pmr::memory_resource* resource,
-    const std::unordered_map<int32_t, std::string> &old_value,
-    const std::vector<std::pair<std::string, int32_t>> &columns) {
-    std::vector<std::pair<int32_t, std::string>> primary_key;
-    primary_key.reserve(old_value.size());
+void otterbrix_service::add_change(postgre_sql_type_operation type_operation,
+                                   const std::string &table_name,
+                                   const std::string &database_name,
+                                   const std::vector<int32_t> &primary_key,
+                                   const replication_row &result,
+                                   const tsl::row_decoder &decoder,
+                                   const replication_row &old_value) {
+    if (type_operation == postgre_sql_type_operation::NOT_PROCESSED) {
+        return;
+    }
+
+    apply_context & apply = get_context();
+    table_batch & batch = get_batch(database_name, table_name);
+    if (batch.type_operation != type_operation) {
+        flush_batch(batch);
+        batch.type_operation = type_operation;
+    }
+
+    switch (type_operation) {
+        case postgre_sql_type_operation::INSERT: {
+            document_ptr document = tsl::logical_replication_to_doc(&apply.arena, decoder, result);
+            batch.documents.push_back(std::move(document));
+            ++apply.pending;
+            break;
+        }
+        case postgre_sql_type_operation::DELETE: {
+            select_key_columns(primary_key, result, decoder, apply.key_columns);
+            if (apply.key_columns.empty()) {
+                throw exception(error_codes::BAD_ARGUMENTS, fmt::format("No key columns to match a row of {}.{}",
+                                                                        database_name, table_name));
+            }
+            if (batch.parameters + apply.key_columns.size() > max_batch_parameters) {
+                flush_batch(batch);
+            }
+            if (!batch.params) {
+                batch.params = logical_plan::make_parameter_node(&apply.arena);
+            }
 
-    for (const auto &entry : old_value) {
-        primary_key.emplace_back(entry.first, entry.second);
+            // Values are bound right away, the row is not kept
+            row_key key_names;
+            key_names.reserve(apply.key_columns.size());
+            for (int32_t column : apply.key_columns) {
+                ++batch.parameters;
+                tsl::add_key_parameter(batch.params, id_par{static_cast<unsigned short>(batch.parameters)},
+                                       result[column], decoder[column]);
+                key_names.push_back(decoder[column].name);
+            }
+            batch.keys.push_back(std::move(key_names));
+            ++apply.pending;
+            break;
+        }
+        case postgre_sql_type_operation::UPDATE:
+            // Every update carries its own document, they are not combined
+            data_handler(type_operation, table_name, database_name, primary_key, result, decoder, old_value);
+            break;
+        case postgre_sql_type_operation::NOT_PROCESSED:
+            break;
     }
+}
 
-    size_t primary_key_size = primary_key.size();
-    if (primary_key_size == 1) {
-        auto params = logical_plan::make_parameter_node(resource);
-        params->add_parameter<std::string>(id_par{1}, primary_key[0].second);
-        auto expr = components::expressions::make_compare_expression(resource,
-                                                                     compare_type::eq,
-                                                                     key{columns[primary_key[0].first].first},
-                                                                     id_par{1});
-        return {expr, params};
+void otterbrix_service::add_upsert(const std::string &table_name,
+                                   const std::string &database_name,
+                                   const std::vector<int32_t> &primary_key,
+                                   const replication_row &result,
+                                   const tsl::row_decoder &decoder) {
+    if (primary_key.empty()) {
+        throw exception(error_codes::BAD_ARGUMENTS, fmt::format("No primary key to match a row of {}.{}",
+                                                                database_name, table_name));
     }
 
-    unsigned short index = 0;
-    auto expr_result = components::expressions::make_compare_union_expression(resource, compare_type::union_and);
-    auto expr = expr_result;
-    auto params = logical_plan::make_parameter_node(resource);
+    // Written right away like an update, the next insert or delete starts a new batch
+    table_batch & batch = get_batch(database_name, table_name);
+    if (batch.type_operation != postgre_sql_type_operation::UPDATE) {
+        flush_batch(batch);
+        batch.type_operation = postgre_sql_type_operation::UPDATE;
+    }
+    write_update(table_name, database_name, primary_key, result, decoder, {}, true);
+}
+
+void otterbrix_service::flush() {
+    if (!context) {
+        return;
+    }
+    for (auto & [name, batch] : context->batches) {
+        flush_batch(batch);
+    }
+    // Nothing written refers to the arena any more
+    context->arena.release();
+}
+
+size_t otterbrix_service::pending_changes() const {
+    return context ? context->pending : 0;
+}
+
+void otterbrix_service::flush_batch(table_batch &batch) {
+    apply_context & apply = *context;
+    otterbrix::session_id_t session_id;
 
-    while (primary_key_size > 2) {
-        auto expr_union = components::expressions::make_compare_union_expression(resource, compare_type::union_and);
-        auto expr_eq = components::expressions::make_compare_expression(resource,
-                                                                        compare_type::eq,
-                                                                        key{columns[primary_key[index].first].first},
-                                                                        id_par{static_cast<unsigned short>(index + 1)});
-        params->add_parameter(id_par{static_cast<unsigned short>(index + 1)}, primary_key[index].second);
-        expr->append_child(expr_union);
-        expr->append_child(expr_eq);
-        expr = expr_union;
-        index += 1;
-        primary_key_size -= 1;
-    }
-
-    auto expr_eq_left = components::expressions::make_compare_expression(resource,
-                                                                         compare_type::eq,
-                                                                         key{columns[primary_key[index].first].first},
-                                                                         id_par{static_cast<unsigned short>(index + 1)});
-    params->add_parameter(id_par{static_cast<unsigned short>(index + 1)}, primary_key[index].second);
-    auto expr_eq_right = components::expressions::make_compare_expression(resource,
-                                                                          compare_type::eq,
-                                                                          key{columns[primary_key[index + 1].first].first},
-                                                                          id_par{static_cast<unsigned short>(index + 2)});
-    params->add_parameter(id_par{static_cast<unsigned short>(index + 2)}, primary_key[index + 1].second);
-    expr->append_child(expr_eq_left);
-    expr->append_child(expr_eq_right);
-
-    return {expr_result, params};
+    // The batch is emptied before writing, a failed write is not repeated by the next flush
+    if (!batch.documents.empty()) {
+        std::pmr::vector<document_ptr> documents(&apply.resource);
+        documents.swap(batch.documents);
+        apply.pending -= documents.size();
+
+        auto insert_node = logical_plan::make_node_insert(&apply.arena,
+                                                          {batch.database_name, batch.table_name},
+                                                          std::move(documents));
+        std::lock_guard guard(apply.writer->write_mutex);
+        apply.writer->wal.insert_many(session_id, apply.writer->manager_addr, insert_node);
+    }
+
+    if (!batch.keys.empty()) {
+        std::vector<row_key> keys;
+        keys.swap(batch.keys);
+        logical_plan::parameter_node_ptr params = std::move(batch.params);
+        batch.params = nullptr;
+        apply.pending -= keys.size();
+        batch.parameters = 0;
+
+        auto node_match = logical_plan::make_node_match(&apply.arena,
+                                                        {batch.database_name, batch.table_name},
+                                                        make_expression_match(&apply.arena, keys));
+        if (keys.size() == 1) {
+            auto node_delete = logical_plan::make_node_delete_one(&apply.arena,
+                                                                  {batch.database_name, batch.table_name},
+                                                                  node_match);
+            std::lock_guard guard(apply.writer->write_mutex);
+            apply.writer->wal.delete_one(session_id, apply.writer->manager_addr, node_delete, params);
+        } else {
+            auto node_delete = logical_plan::make_node_delete_many(&apply.arena,
+                                                                   {batch.database_name, batch.table_name},
+                                                                   node_match);
+            std::lock_guard guard(apply.writer->write_mutex);
+            apply.writer->wal.delete_many(session_id, apply.writer->manager_addr, node_delete, params);
+        }
+    }
 }
 
 std::pair<expressions::expression_ptr, logical_plan::parameter_node_ptr> otterbrix_service::make_expression_match(
     std::pmr::memory_resource* resource,
+    const std::string &database_name,
+    const std::string &table_name,
     const std::vector<int32_t> &primary_key,
-    const std::vector<std::string> &result,
-    const std::vector<std::pair<std::string, int32_t>> &columns) {
-    size_t primary_key_size = primary_key.size();
-    if (primary_key_size == 1) {
-        auto params = logical_plan::make_parameter_node(resource);
-        params->add_parameter(id_par{1}, result[primary_key[0]]);
-        auto expr = components::expressions::make_compare_expression(resource,
-                                                                     compare_type::eq,
-                                                                     key{columns[primary_key[0]].first},
-                                                                     id_par{1});
-        return {expr, params};
-    }
-
-    int32_t index = 0;
-    auto expr_result = components::expressions::make_compare_union_expression(resource, compare_type::union_and);
-    auto expr = expr_result;
+    const replication_row &row,
+    const tsl::row_decoder &decoder) {
+    apply_context & apply = get_context();
+    std::vector<int32_t> & key_columns = apply.key_columns;
+    select_key_columns(primary_key, row, decoder, key_columns);
+    if (key_columns.empty()) {
+        throw exception(error_codes::BAD_ARGUMENTS, fmt::format("No key columns to match a row of {}.{}",
+                                                                database_name, table_name));
+    }
+
+    const match_template & match = get_match_template(database_name, table_name, key_columns, decoder);
+
     auto params = logical_plan::make_parameter_node(resource);
+    for (size_t index = 0; index < match.key_columns.size(); ++index) {
+        int32_t column = match.key_columns[index];
+        tsl::add_key_parameter(params, id_par{static_cast<unsigned short>(index + 1)},
+                               row[column], decoder[column]);
+    }
+    return {match.expression, params};
+}
+
+const otterbrix_service::match_template & otterbrix_service::get_match_template(
+    const std::string &database_name,
+    const std::string &table_name,
+    const std::vector<int32_t> &key_columns,
+    const tsl::row_decoder &decoder) {
+    apply_context & apply = get_context();
+    std::vector<match_template> & templates = apply.match_templates[database_name + '.' + table_name];
 
-    while (primary_key_size > 2) {
-        auto expr_union = components::expressions::make_compare_union_expression(resource, compare_type::union_and);
-        auto expr_eq = components::expressions::make_compare_expression(resource,
-                                                                        compare_type::eq,
-                                                                        key{columns[primary_key[index]].first},
-                                                                        id_par{static_cast<unsigned short>(index + 1)});
-        params->add_parameter(id_par{static_cast<unsigned short>(index + 1)}, result[primary_key[index]]);
-        expr->append_child(expr_union);
-        expr->append_child(expr_eq);
-        expr = expr_union;
-        index += 1;
-        primary_key_size -= 1;
-    }
-
-    auto expr_eq_left = components::expressions::make_compare_expression(resource,
-                                                                         compare_type::eq,
-                                                                         key{columns[primary_key[index]].first},
-                                                                         id_par{static_cast<unsigned short>(index + 1)});
-    params->add_parameter(id_par{static_cast<unsigned short>(index + 1)}, result[primary_key[index]]);
-    auto expr_eq_right = components::expressions::make_compare_expression(resource,
-                                                                          compare_type::eq,
-                                                                          key{columns[primary_key[index + 1]].first},
-                                                                          id_par{static_cast<unsigned short>(index + 2)});
-    params->add_parameter(id_par{static_cast<unsigned short>(index + 2)}, result[primary_key[index + 1]]);
-    expr->append_child(expr_eq_left);
-    expr->append_child(expr_eq_right);
-
-    return {expr_result, params};
-}
\ No newline at end of file
+    auto same_names = [&](const match_template & match) {
+        for (size_t index = 0; index < key_columns.size(); ++index) {
+            if (match.key_names[index] != decoder[key_columns[index]].name) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    // Most recently used first, the last one makes room for a new key
+    auto found = std::find_if(templates.begin(), templates.end(), [&](const match_template & candidate) {
+        return candidate.key_columns == key_columns;
+    });
+    if (found != templates.end()) {
+        std::rotate(templates.begin(), found, found + 1);
+        if (same_names(templates.front())) {
+            return templates.front();
+        }
+    } else {
+        if (templates.size() >= max_match_templates) {
+            templates.pop_back();
+        }
+        templates.emplace(templates.begin());
+    }
+    match_template * match = &templates.front();
+
+    match->key_columns = key_columns;
+    match->key_names.clear();
+    for (int32_t column : key_columns) {
+        match->key_names.push_back(decoder[column].name);
+    }
+
+    // Templates outlive batches, they are built in the context's pool rather than the arena
+    if (key_columns.size() == 1) {
+        match->expression = components::expressions::make_compare_expression(&apply.resource,
+                                                                             compare_type::eq,
+                                                                             key{match->key_names[0]},
+                                                                             id_par{1});
+    } else {
+        auto expr = components::expressions::make_compare_union_expression(&apply.resource, compare_type::union_and);
+        for (size_t index = 0; index < key_columns.size(); ++index) {
+            expr->append_child(components::expressions::make_compare_expression(&apply.resource,
+                                                                                compare_type::eq,
+                                                                                key{match->key_names[index]},
+                                                                                id_par{static_cast<unsigned short>(index + 1)}));
+        }
+        match->expression = expr;
+    }
+    return *match;
+}
+
+void otterbrix_service::select_key_columns(const std::vector<int32_t> &primary_key,
+                                           const replication_row &row,
+                                           const tsl::row_decoder &decoder,
+                                           std::vector<int32_t> &key_columns) {
+    key_columns.clear();
+    if (!primary_key.empty()) {
+        key_columns.assign(primary_key.begin(), primary_key.end());
+        return;
+    }
+
+    for (size_t column = 0; column < row.size() && column < decoder.size(); ++column) {
+        if (!row.is_null(column)) {
+            key_columns.push_back(static_cast<int32_t>(column));
+        }
+    }
+}
+
+expressions::expression_ptr otterbrix_service::make_expression_match(std::pmr::memory_resource* resource,
+                                                                     const std::vector<row_key> &rows) {
+    unsigned short parameter = 0;
+
+    auto make_row_match = [&](const row_key &row) {
+        auto add_equal = [&](const std::string &name) {
+            ++parameter;
+            return components::expressions::make_compare_expression(resource,
+                                                                    compare_type::eq,
+                                                                    key{name},
+                                                                    id_par{parameter});
+        };
+
+        if (row.size() == 1) {
+            return add_equal(row.front());
+        }
+        auto expr = components::expressions::make_compare_union_expression(resource, compare_type::union_and);
+        for (const auto &name : row) {
+            expr->append_child(add_equal(name));
+        }
+        return expr;
+    };
+
+    if (rows.size() == 1) {
+        return make_row_match(rows.front());
+    }
+
+    auto expr = components::expressions::make_compare_union_expression(resource, compare_type::union_or);
+    for (const auto &row : rows) {
+        expr->append_child(make_row_match(row));
+    }
+    return expr;
+}
@@ -0,0 +1,204 @@
+#include <cerrno>
+#include <poll.h>
+#include <fmt/format.h>
+
+#include <postgres/replication_stream.h>
+#include <postgres/postgres_binary.h>
+#include <postgres/postgres_types.h>
+#include <common/exception.h>
+
+namespace
+{
+    /// Microseconds between 1970-01-01 and 2000-01-01, PostgreSQL timestamps start from the latter.
+    constexpr int64_t postgres_epoch_offset_us = 946684800000000LL;
+
+    constexpr size_t xlog_data_header_size = 1 + 8 + 8 + 8;
+    constexpr size_t keepalive_size = 1 + 8 + 8 + 1;
+    constexpr size_t standby_status_size = 1 + 8 + 8 + 8 + 8 + 1;
+
+    int64_t current_postgres_time()
+    {
+        auto now = std::chrono::system_clock::now().time_since_epoch();
+        return std::chrono::duration_cast<std::chrono::microseconds>(now).count() - postgres_epoch_offset_us;
+    }
+}
+
+namespace postgres
+{
+    replication_stream::replication_stream(const std::string & connection_dsn_, logger *logger_)
+        : connection_dsn(fmt::format("{}?replication=database", connection_dsn_)),
+          current_logger(logger_) {
+    }
+
+    replication_stream::~replication_stream()
+    {
+        close();
+    }
+
+    void replication_stream::connect()
+    {
+        if (connection && PQstatus(connection) == CONNECTION_OK)
+            return;
+
+        close();
+        connection = PQconnectdb(connection_dsn.c_str());
+        if (PQstatus(connection) != CONNECTION_OK)
+        {
+            std::string error_message = PQerrorMessage(connection);
+            close();
+            throw exception(error_codes::LOGICAL_ERROR,
+                            fmt::format("Replication connection failed: {}", error_message));
+        }
+
+        current_logger->log_to_file(log_level::DEBUG, fmt::format("New replication stream connection {}", connection_dsn));
+    }
+
+    void replication_stream::start(const std::string & slot_name, uint64_t start_lsn, const std::string & options)
+    {
+        connect();
+
+        std::string query_str = fmt::format("START_REPLICATION SLOT \"{}\" LOGICAL {} ({})",
+                                            slot_name, lsn_to_string(start_lsn), options);
+
+        PGresult *result = PQexec(connection, query_str.c_str());
+        ExecStatusType status = PQresultStatus(result);
+        PQclear(result);
+
+        if (status != PGRES_COPY_BOTH)
+        {
+            std::string error_message = PQerrorMessage(connection);
+            close();
+            throw exception(error_codes::LOGICAL_ERROR,
+                            fmt::format("Could not start replication for slot {}: {}", slot_name, error_message));
+        }
+
+        started = true;
+        current_logger->log_to_file(log_level::INFO, fmt::format(
+                       "Started streaming replication for slot {} from lsn {}", slot_name, lsn_to_string(start_lsn)));
+    }
+
+    bool replication_stream::wait_readable(std::chrono::milliseconds timeout)
+    {
+        pollfd descriptor{};
+        descriptor.fd = PQsocket(connection);
+        descriptor.events = POLLIN;
+
+        int ready = ::poll(&descriptor, 1, static_cast<int>(timeout.count()));
+        if (ready < 0 && errno != EINTR)
+            throw exception(error_codes::LOGICAL_ERROR, fmt::format("poll() on replication socket failed: {}", errno));
+
+        return ready > 0;
+    }
+
+    void replication_stream::release_buffer()
+    {
+        if (copy_buffer)
+        {
+            PQfreemem(copy_buffer);
+            copy_buffer = nullptr;
+        }
+    }
+
+    stream_status replication_stream::read(replication_message & message, std::chrono::milliseconds timeout)
+    {
+        if (!started)
+            throw exception(error_codes::LOGICAL_ERROR, "Replication stream is not started");
+
+        while (true)
+        {
+            release_buffer();
+            int length = PQgetCopyData(connection, &copy_buffer, 1);
+
+            if (length == 0)
+            {
+                if (!wait_readable(timeout))
+                    return stream_status::TIMEOUT;
+
+                if (!PQconsumeInput(connection))
+                    throw exception(error_codes::LOGICAL_ERROR,
+                                    fmt::format("Could not receive data from server: {}", PQerrorMessage(connection)));
+                continue;
+            }
+
+            if (length == -1)
+            {
+                PGresult *result = PQgetResult(connection);
+                PQclear(result);
+                started = false;
+                current_logger->log_to_file(log_level::INFO, "Replication stream finished by server");
+                return stream_status::END;
+            }
+
+            if (length < 0)
+                throw exception(error_codes::LOGICAL_ERROR,
+                                fmt::format("Could not read COPY data: {}", PQerrorMessage(connection)));
+
+            switch (copy_buffer[0])
+            {
+                case 'w': // XLogData
+                {
+                    if (static_cast<size_t>(length) < xlog_data_header_size)
+                        throw exception(error_codes::LOGICAL_ERROR, "Streaming header too small");
+
+                    message.wal_start = binary::read_be<uint64_t>(copy_buffer + 1);
+                    message.wal_end = binary::read_be<uint64_t>(copy_buffer + 9);
+                    message.send_time = binary::read_be<int64_t>(copy_buffer + 17);
+                    message.reply_requested = false;
+                    message.data = copy_buffer + xlog_data_header_size;
+                    message.size = length - xlog_data_header_size;
+                    return stream_status::DATA;
+                }
+                case 'k': // Primary keepalive
+                {
+                    if (static_cast<size_t>(length) < keepalive_size)
+                        throw exception(error_codes::LOGICAL_ERROR, "Keepalive message too small");
+
+                    message.wal_start = 0;
+                    message.wal_end = binary::read_be<uint64_t>(copy_buffer + 1);
+                    message.send_time = binary::read_be<int64_t>(copy_buffer + 9);
+                    message.reply_requested = copy_buffer[17] != 0;
+                    message.data = nullptr;
+                    message.size = 0;
+                    return stream_status::KEEPALIVE;
+                }
+                default:
+                {
+                    current_logger->log_to_file(log_level::WARNING,
+                                                fmt::format("Unrecognized streaming header: {}", copy_buffer[0]));
+                    break;
+                }
+            }
+        }
+    }
+
+    void replication_stream::send_status(uint64_t written_lsn, uint64_t flushed_lsn, uint64_t applied_lsn, bool reply_requested)
+    {
+        if (!started)
+            return;
+
+        char reply[standby_status_size];
+        reply[0] = 'r';
+        binary::write_be<uint64_t>(reply + 1, written_lsn);
+        binary::write_be<uint64_t>(reply + 9, flushed_lsn);
+        binary::write_be<uint64_t>(reply + 17, applied_lsn);
+        binary::write_be<int64_t>(reply + 25, current_postgres_time());
+        reply[33] = reply_requested ? 1 : 0;
+
+        if (PQputCopyData(connection, reply, standby_status_size) <= 0 || PQflush(connection))
+            throw exception(error_codes::LOGICAL_ERROR,
+                            fmt::format("Could not send feedback packet: {}", PQerrorMessage(connection)));
+
+        current_logger->log_to_file(log_level::DEBUG, fmt::format("Confirmed flush up to: {}", lsn_to_string(flushed_lsn)));
+    }
+
+    void replication_stream::close()
+    {
+        release_buffer();
+        if (connection)
+        {
+            PQfinish(connection);
+            connection = nullptr;
+        }
+        started = false;
+    }
+}